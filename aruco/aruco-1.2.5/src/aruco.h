@@ -131,4 +131,5 @@ For testing the applications, the library provides videos and the corresponding
 #include "markerdetector.h"
 #include "boarddetector.h"
 #include "cvdrawingutils.h"
+#include "framelog.h"
 
@@ -33,11 +33,20 @@ or implied, of Rafael Muñoz Salinas.
 
 /**
  */
-EMClassifier::EMClassifier(unsigned int nelements) : _classifier(2, cv::EM::COV_MAT_DIAGONAL, cv::TermCriteria(cv::TermCriteria::COUNT , 4, FLT_EPSILON))
+EMClassifier::EMClassifier(unsigned int nelements)
 {
   _nelem = nelements;
   _threshProb = 0.0001;
-  for(unsigned int i=0; i<256; i++) _prob[i] = 0.5;
+  for(unsigned int i=0; i<256; i++) {
+    _prob[i] = 0.5;
+    _inside[i] = false;
+    _histogram[i] = 0.;
+  }
+  for(unsigned int k=0; k<2; k++) {
+    _weight[k] = 0.5;
+    _mean[k] = 0.;
+    _var[k] = 1.;
+  }
 }
 
 
@@ -48,52 +57,162 @@ void EMClassifier::train()
 {
 
   // fill histogram
-    
-  for(unsigned int i=0; i<256;i++) _histogram[i]=0;
-  
-  for(unsigned int i=0; i<_samples.size(); i++) {
-    uchar val = _samples[i];
-    _histogram[val]+=3;
-    if(val>0) _histogram[val-1]+=2;
-    if(val<255) _histogram[val+1]+=2;
-    if(val>1) _histogram[val-2]+=1;
-    if(val<254) _histogram[val+2]+=1;	  
-  }
   
-  double sum=0.;     
-  for(unsigned int i=0; i<256;i++) sum += _histogram[i];
-  for(unsigned int i=0; i<256;i++) _histogram[i] /= sum;
+  unsigned int counts[256];
+  for(unsigned int i=0; i<256;i++) counts[i]=0;
+  for(unsigned int i=0; i<_samples.size(); i++) counts[_samples[i]]++;
   
+  smoothHistogram(counts, _histogram);
   
-  // discretize histogram to speed up training
-  unsigned int histCount[256];
-  int  n=0;
+  // same minimum amount of data the sample-based training required
+  unsigned int n=0;
   for(unsigned int i=0; i<256; i++)
-    n+= (histCount[i] = (unsigned int)(_nelem*_histogram[i]));
-
+    n += (unsigned int)(_nelem*_histogram[i]);
   if(n<10) return;
   
-  cv::Mat samples(n,1,CV_64FC1);
-  unsigned int idx=0;
-  for(unsigned int i=0; i<256; i++) {
-    for(unsigned int j=0; j<histCount[i]; j++) {
-      samples.ptr<double>(0)[idx] = i;
-      idx++;
-    }
-  }  
-  
-  _classifier.train(samples);
+  fitHistogram();
   
-  cv::Mat sampleAux(1,1,CV_64FC1);
-  for(unsigned int i=0; i<256; i++) {
-    sampleAux.ptr<double>(0)[0] = i;
-    cv::Vec2d r = _classifier.predict(sampleAux);
-    _prob[i] = exp(r[0]);
-    if(_prob[i]>_threshProb) _inside[i]=true;
-    else _inside[i]=false;
-  }  
+}
+
+
+
+/**
+ */
+void EMClassifier::train(const double *histogram)
+{
+  double sum=0.;
+  for(unsigned int i=0; i<256; i++) sum += histogram[i];
+  if(sum==0.) return;
+  for(unsigned int i=0; i<256; i++) _histogram[i] = histogram[i]/sum;
+  fitHistogram();
+}
+
+
+
+/**
+ * L1 distance between a normalised histogram and the one the classifier was last fitted on
+ */
+double EMClassifier::drift(const double *histogram) const
+{
+  double d=0.;
+  for(unsigned int i=0; i<256; i++) d += fabs(histogram[i]-_histogram[i]);
+  return d;
+}
+
+
+
+/**
+ * Smooths the intensity counts with a (1 2 3 2 1) kernel and normalises the result.
+ * Leaves an all-zero histogram when there are no counts.
+ */
+void EMClassifier::smoothHistogram(const unsigned int *counts, double *histogram)
+{
+  for(unsigned int i=0; i<256;i++) histogram[i]=0;
+  
+  for(unsigned int val=0; val<256; val++) {
+    if(counts[val]==0) continue;
+    double c = counts[val];
+    histogram[val]+=3*c;
+    if(val>0) histogram[val-1]+=2*c;
+    if(val<255) histogram[val+1]+=2*c;
+    if(val>1) histogram[val-2]+=c;
+    if(val<254) histogram[val+2]+=c;
+  }
   
+  double sum=0.;     
+  for(unsigned int i=0; i<256;i++) sum += histogram[i];
+  if(sum==0.) return;
+  for(unsigned int i=0; i<256;i++) histogram[i] /= sum;
+}
+
+
+
+/**
+ * Weighted EM for a 1D mixture of two gaussians, where the samples are the 256 intensities
+ * weighted by the normalised _histogram. Each iteration costs O(256), independently of the
+ * number of samples; the resulting density is tabulated into _prob in closed form.
+ */
+void EMClassifier::fitHistogram()
+{
+  const unsigned int maxIter = 10;
+  const double minVar = 1.;	// the smoothing kernel alone has a variance of 4/3
+  const double norm = 1./sqrt(2.*CV_PI);
+  double resp[256];
+  
+  // initialise from the moments of the histogram: components at one standard deviation
+  // on each side of the mean
+  double mean=0., var=0.;
+  for(unsigned int i=0; i<256; i++) mean += i*_histogram[i];
+  for(unsigned int i=0; i<256; i++) var += (i-mean)*(i-mean)*_histogram[i];
+  double sd = sqrt(std::max(var, minVar));
+  _weight[0] = _weight[1] = 0.5;
+  _mean[0] = mean-sd;
+  _mean[1] = mean+sd;
+  _var[0] = _var[1] = std::max(var/2., minVar);
+  
+  double prevLogLik = -DBL_MAX;
+  for(unsigned int iter=0; iter<maxIter; iter++) {
+    
+    // E step: responsibility of component 0 for each intensity
+    double c[2], e[2];
+    for(unsigned int k=0; k<2; k++) {
+      c[k] = _weight[k]*norm/sqrt(_var[k]);
+      e[k] = -0.5/_var[k];
+    }
+    double logLik = 0.;
+    for(unsigned int i=0; i<256; i++) {
+      double d0 = i-_mean[0], d1 = i-_mean[1];
+      double p0 = c[0]*exp(e[0]*d0*d0);
+      double p1 = c[1]*exp(e[1]*d1*d1);
+      double p = p0+p1;
+      resp[i] = p>0. ? p0/p : (fabs(d0)<fabs(d1) ? 1. : 0.);
+      if(_histogram[i]>0.) logLik += _histogram[i]*log(std::max(p, DBL_MIN));
+    }
+    
+    // M step
+    double n0=0., n1=0., s0=0., s1=0.;
+    for(unsigned int i=0; i<256; i++) {
+      double h0 = _histogram[i]*resp[i];
+      double h1 = _histogram[i]-h0;
+      n0 += h0; s0 += h0*i;
+      n1 += h1; s1 += h1*i;
+    }
+    if(n0<=DBL_EPSILON || n1<=DBL_EPSILON) {
+      // one component vanished: a single gaussian describes the cell
+      _weight[0] = 1.; _weight[1] = 0.;
+      _mean[0] = _mean[1] = mean;
+      _var[0] = _var[1] = std::max(var, minVar);
+      break;
+    }
+    _mean[0] = s0/n0;
+    _mean[1] = s1/n1;
+    double v0=0., v1=0.;
+    for(unsigned int i=0; i<256; i++) {
+      double h0 = _histogram[i]*resp[i];
+      double h1 = _histogram[i]-h0;
+      v0 += h0*(i-_mean[0])*(i-_mean[0]);
+      v1 += h1*(i-_mean[1])*(i-_mean[1]);
+    }
+    _var[0] = std::max(v0/n0, minVar);
+    _var[1] = std::max(v1/n1, minVar);
+    _weight[0] = n0/(n0+n1);
+    _weight[1] = n1/(n0+n1);
+    
+    if(logLik-prevLogLik < 1e-6) break;
+    prevLogLik = logLik;
+  }
   
+  // mixture density for every intensity
+  for(unsigned int i=0; i<256; i++) {
+    double p = 0.;
+    for(unsigned int k=0; k<2; k++) {
+      if(_weight[k]==0.) continue;
+      double d = i-_mean[k];
+      p += _weight[k]*norm/sqrt(_var[k])*exp(-0.5*d*d/_var[k]);
+    }
+    _prob[i] = p;
+    _inside[i] = p>_threshProb;
+  }
 }
 
 
@@ -146,19 +265,26 @@ void ChromaticMask::setParams(unsigned int mc, unsigned int nc, double threshPro
   _mc = mc;
   _nc = nc;
   _threshProb = threshProb;
+  _cell_neighbours.clear();
   _cell_neighbours.resize(mc*nc);
+  _cellLayout.resize(mc*nc);
+  _centers.clear();
   int idx_=0;
-  //SGJ: revisar, no engo claro sepa bien que es i y j y los puedo estar confundiendo!!!
-    for(unsigned int j=0; j<nc; j++)
-      for(unsigned int i=0; i<mc; i++,idx_++) {
+  for(unsigned int j=0; j<nc; j++)
+    for(unsigned int i=0; i<mc; i++,idx_++) {
       _centers.push_back(cv::Point2f(i+0.5, j+0.5));
-      for(unsigned int nj=max(j-1,(unsigned int)0); nj<min(mc,j+1); nj++) {
-         for(unsigned int ni=max(i-1,(unsigned int)0); ni<min(mc,i+1); ni++) {
-	   size_t tidx=nj*mc+ni;
-           _cell_neighbours[idx_].push_back(tidx);           
-	}      
+      // 3x3 neighbourhood clipped to the board, in row-major order
+      for(int dj=-1; dj<=1; dj++) {
+        for(int di=-1; di<=1; di++) {
+          int ni=int(i)+di, nj=int(j)+dj;
+          if(ni<0 || ni>=int(mc) || nj<0 || nj>=int(nc)) continue;
+          _cell_neighbours[idx_].push_back(nj*mc+ni);
+        }
       }
+      // which sides of the cell have neighbours (left, right, top, bottom)
+      _cellLayout[idx_] = (i>0 ? 1 : 0) | (i+1<mc ? 2 : 0) | (j>0 ? 4 : 0) | (j+1<nc ? 8 : 0);
     }
+  calculateNeighbourWeights();
   
     //deterimne the idx of the neighbours
   _BD.getMarkerDetector().setThresholdParams(35,7);
@@ -171,14 +297,13 @@ void ChromaticMask::setParams(unsigned int mc, unsigned int nc, double threshPro
   _objCornerPoints = corners;
   _CP = CP;
   
-  _pixelsVector.clear();
-  for(unsigned int i=0; i<CP.CamSize.height/2; i++)
-    for(unsigned int j=0; j<CP.CamSize.width/2; j++)
-      _pixelsVector.push_back( cv::Point2f(2*j,2*i) );
+  _cellHist.assign(mc*nc*256, 0.);
+  _cellCounts.assign(mc*nc*256, 0);
   
   resetMask();
   _cellMap = cv::Mat(CP.CamSize.height, CP.CamSize.width, CV_8UC1, cv::Scalar::all(0));
-  _canonicalPos = cv::Mat(CP.CamSize.height, CP.CamSize.width, CV_8UC2);
+  _canonicalPos = cv::Mat(CP.CamSize.height, CP.CamSize.width, CV_8UC2, cv::Scalar::all(0));
+  _gridValid = false;
     
   _cellCenters.resize(_classifiers.size());
   for(unsigned int i=0; i<mc; i++) {
@@ -190,7 +315,20 @@ void ChromaticMask::setParams(unsigned int mc, unsigned int nc, double threshPro
   
 }
 
-pair<double,double> AvrgTime(0,0) ;
+cv::Rect fitRectToSize(cv::Rect r,cv::Size size){
+  
+       r.x=max(r.x,0);
+      r.y=max(r.y,0);
+      int endx=r.x+r.width;
+      int endy=r.y+r.height;
+      endx=min(endx,size.width);
+      endy=min(endy,size.height);
+      r.width=endx-r.x;
+      r.height=endy-r.y;
+      return r;
+ 
+}
+
 
 /**
  */
@@ -200,6 +338,16 @@ void ChromaticMask::calculateGridImage(const aruco::Board &board )
       // project corner points to image
       cv::projectPoints(_objCornerPoints, board.Rvec, board.Tvec, _CP.CameraMatrix, _CP.Distorsion, _imgCornerPoints);    
 
+      // reuse the previous map while the board has not moved noticeably
+      if(_gridValid) {
+	float maxDist=0.f;
+	for(int i=0; i<4; i++) {
+	  cv::Point2f d = _imgCornerPoints[i]-_gridCornerPoints[i];
+	  maxDist = std::max(maxDist, std::max(fabs(d.x), fabs(d.y)));
+	}
+	if(maxDist < _gridReuseThresh) return;
+      }
+      
       //obtain the perspective transform
       cv::Point2f  pointsRes[4],pointsIn[4];
       for ( int i=0;i<4;i++ ) pointsIn[i]=_imgCornerPoints[i];
@@ -209,33 +357,36 @@ void ChromaticMask::calculateGridImage(const aruco::Board &board )
       pointsRes[3]= cv::Point2f ( 0, _cellSize*_nc-1 );
       _perpTrans=cv::getPerspectiveTransform ( pointsIn,pointsRes );
       
-double tick = (double)cv::getTickCount();	
-		
-      vector<cv::Point2f> transformedPixels;
-      cv::perspectiveTransform(_pixelsVector, transformedPixels, _perpTrans);        
-		
-             AvrgTime.first+=((double)cv::getTickCount()-tick)/cv::getTickFrequency(); AvrgTime.second++;      
- 	    cout<<"Time cc detection="<<1000*AvrgTime.first/AvrgTime.second<<" milliseconds"<<endl;		
+      // only the previous board region can hold non-zero cells
+      if(_gridValid) {
+	_cellMap(_gridRect).setTo(cv::Scalar::all(0));
+      }
       
- 
-            
-      cv::Rect cellRect(0,0,_mc,_nc);
-      for(unsigned int i=0; i<transformedPixels.size(); i++) {
-	//_canonicalPos.at<cv::Vec2b>(_pixelsVector[i].y, _pixelsVector[i].x) = cv::Vec2b(transformedPixels[i].x, transformedPixels[i].y);
-	transformedPixels[i].x /= _cellSize;
-	transformedPixels[i].y /= _cellSize;
-	if( !transformedPixels[i].inside(cellRect) ) {
-	  _cellMap.at<uchar>( _pixelsVector[i].y, _pixelsVector[i].x ) = 0;
-	  _cellMap.at<uchar>( _pixelsVector[i].y+1, _pixelsVector[i].x ) = 0;
-	  _cellMap.at<uchar>( _pixelsVector[i].y, _pixelsVector[i].x+1 ) = 0;
-	  _cellMap.at<uchar>( _pixelsVector[i].y+1, _pixelsVector[i].x+1 ) = 0;
-	}
-	else {
-      uchar cellNum = (unsigned int)transformedPixels[i].y*_nc + (unsigned int)transformedPixels[i].x;
-	  _cellMap.at<uchar>( _pixelsVector[i].y, _pixelsVector[i].x ) = 1+cellNum;
-	  _cellMap.at<uchar>( _pixelsVector[i].y+1, _pixelsVector[i].x ) = 1+cellNum;	  
-	  _cellMap.at<uchar>( _pixelsVector[i].y, _pixelsVector[i].x+1 ) = 1+cellNum;
-	  _cellMap.at<uchar>( _pixelsVector[i].y+1, _pixelsVector[i].x+1 ) = 1+cellNum;	  
+      // the part of the board inside the image (none if it is entirely off-image):
+      cv::Rect r = cv::boundingRect(_imgCornerPoints) & cv::Rect(cv::Point(), _cellMap.size());
+      _gridValid = false;
+      if(r.area() <= 0) return;
+      _gridCornerPoints = _imgCornerPoints;
+      _gridRect = r;
+      _gridValid = true;
+      
+      // rasterise the board line by line, stepping the homography along each row
+      const double *H=_perpTrans.ptr<double>(0);
+      const double invCellSize = 1./_cellSize;
+      const double maxU = _cellSize*_mc, maxV = _cellSize*_nc;
+      const int mc = _mc;
+      #pragma omp parallel for
+      for(int y=r.y; y<r.y+r.height; y++) {
+	uchar *cell_ptr = _cellMap.ptr<uchar>(y);
+	double X = r.x*H[0] + y*H[1] + H[2];
+	double Y = r.x*H[3] + y*H[4] + H[5];
+	double Z = r.x*H[6] + y*H[7] + H[8];
+	for(int x=r.x; x<r.x+r.width; x++, X+=H[0], Y+=H[3], Z+=H[6]) {
+	  double invZ = 1./Z;
+	  double u = X*invZ, v = Y*invZ;
+	  if(!(u>=0. && v>=0. && u<maxU && v<maxV)) continue;	// also skips NaN (X = Z = 0)
+	  unsigned int cellNum = (unsigned int)(v*invCellSize)*mc + (unsigned int)(u*invCellSize);
+	  cell_ptr[x] = 1+cellNum;
 	}
       }
           
@@ -260,6 +411,12 @@ void ChromaticMask::train(const cv::Mat& in, const aruco::Board &board)
   
   for(unsigned int i=0; i<_classifiers.size(); i++) _classifiers[i].train();
   
+  // the online histograms start from the trained ones
+  for(unsigned int i=0; i<_classifiers.size(); i++) {
+    const double *h = _classifiers[i].getHistogram();
+    std::copy(h, h+256, _cellHist.begin()+i*256);
+  }
+  
   
 //   for(uint i=0; i<_mc; i++) {
 //     for(uint j=0; j<_nc; j++) {
@@ -333,18 +490,39 @@ void ChromaticMask::classify(const cv::Mat& in, const aruco::Board &board)
   
 }
 
-cv::Rect fitRectToSize(cv::Rect r,cv::Size size){
-  
-       r.x=max(r.x,0);
-      r.y=max(r.y,0);
-      int endx=r.x+r.width;
-      int endy=r.y+r.height;
-      endx=min(endx,size.width);
-      endy=min(endy,size.height);
-      r.width=endx-r.x;
-      r.height=endy-r.y;
-      return r;
- 
+/**
+ */
+void ChromaticMask::calculateNeighbourWeights()
+{
+  const int nbins = _subCells*_subCells;
+  _neighbourWeights.assign(16*nbins*9, 0.f);
+  
+  for(int layout=0; layout<16; layout++) {
+    for(int sy=0; sy<_subCells; sy++) {
+      for(int sx=0; sx<_subCells; sx++) {
+	// bin centre, relative to the top-left corner of its cell
+	float px = (sx+0.5f)/_subCells;
+	float py = (sy+0.5f)/_subCells;
+	float *w = &_neighbourWeights[ (layout*nbins + sy*_subCells + sx)*9 ];
+	float totalW = 0.f;
+	int k=0;
+	for(int dj=-1; dj<=1; dj++) {
+	  if( (dj<0 && !(layout&4)) || (dj>0 && !(layout&8)) ) continue;
+	  for(int di=-1; di<=1; di++) {
+	    if( (di<0 && !(layout&1)) || (di>0 && !(layout&2)) ) continue;
+	    // L1 distance to the centre of the neighbour cell
+	    float dist = fabs(px-(di+0.5f)) + fabs(py-(dj+0.5f));
+	    float wk = std::max(0.f, 2.f-dist);
+	    wk *= wk;
+	    w[k++] = wk;
+	    totalW += wk;
+	  }
+	}
+	// the own cell is always at distance <= 1, so totalW > 0
+	for(int n=0; n<k; n++) w[n] /= totalW;
+      }
+    }
+  }
 }
 
 /**
@@ -353,71 +531,65 @@ void ChromaticMask::classify2(const cv::Mat& in, const aruco::Board &board)
 {
   
     _mask.create(_CP.CamSize.height, _CP.CamSize.width, CV_8UC1); 
-    _maskAux.create(_CP.CamSize.height, _CP.CamSize.width, CV_8UC1); 
-      _maskAux.setTo(cv::Scalar::all(0));
+    _mask.setTo(cv::Scalar::all(0));
   
       cv::projectPoints(_objCornerPoints, board.Rvec, board.Tvec, _CP.CameraMatrix, _CP.Distorsion, _imgCornerPoints);    
-      //obtain the perspective transform
+      //obtain the perspective transform to cell units, so that cell (i,j) covers [i,i+1)x[j,j+1)
       cv::Point2f  pointsRes[4],pointsIn[4];
       for ( int i=0;i<4;i++ ) pointsIn[i]=_imgCornerPoints[i];
 
       pointsRes[0]= ( cv::Point2f ( 0,0 ) );
-      pointsRes[1]= cv::Point2f ( _mc-1, 0 );
-      pointsRes[2]= cv::Point2f ( _mc-1, _nc-1 );
-      pointsRes[3]= cv::Point2f ( 0, _nc-1 );
+      pointsRes[1]= cv::Point2f ( _mc, 0 );
+      pointsRes[2]= cv::Point2f ( _mc, _nc );
+      pointsRes[3]= cv::Point2f ( 0, _nc );
       _perpTrans=cv::getPerspectiveTransform ( pointsIn,pointsRes );
       
-      cv::Mat pT_32;
-      _perpTrans.convertTo(pT_32,CV_32F);//RMS: CAMBIA A FLOAT       
-      
-//       cout << _perpTrans << endl;
-      
       cv::Rect r = cv::boundingRect(_imgCornerPoints);
       r=fitRectToSize(r,in.size());//fit rectangle to image limits
-      float *H=pT_32.ptr<float>(0);
-// #pragma omp parallel for
-      int ny=0;
-      for(unsigned int y=r.y; y<r.y+r.height; y+=2,ny++) {
+      const double *H=_perpTrans.ptr<double>(0);
+      const int nbins = _subCells*_subCells;
+      const float *weights = &_neighbourWeights[0];
+      const int mc = _mc, nc = _nc;
+      
+      // every pixel of the board's bounding rect is classified; the homography is
+      // stepped along each row, leaving one divide per pixel
+      #pragma omp parallel for
+      for(int y=r.y; y<r.y+r.height; y++) {
 	const uchar* in_ptr = in.ptr<uchar>(y);
-	uchar *_mask_ptr=_maskAux.ptr<uchar>(y);
-	int startx=r.x+ny%2;//alternate starting point
-    for(unsigned int x=startx; x<r.x+r.width; x+=2) {
-	  cv::Point2f point;
-	  float _inv_pointz = 1./ (x*H[6] + y*H[7] + H[8]);
- 	  point.x =_inv_pointz*( x*H[0] + y*H[1] + H[2]);
- 	  point.y =_inv_pointz*( x*H[3] + y*H[4] + H[5]);
-	  cv::Point2i c;
-	  c.x = int(point.x+0.5);
-	  c.y = int(point.y+0.5);
-	  if(c.x<0 || c.x>_mc-1 || c.y<0 || c.y>_nc-1) continue;
- 	  size_t cell_idx=c.y*_mc+ c.x;//SGJ: revisar si esto esta bien!!
-	  float prob=0.0,totalW=0.0,dist,w;
-	  
-      for(unsigned int k=0; k<_cell_neighbours[cell_idx].size(); k++) {
-   	    dist = fabs(point.x-_centers[k].x)+fabs( point.y-_centers[k].y);
-  	    w= (2-dist);
- 	    w*=w;
-// 	    w=1/(1- sqrt( (point.x-_centers[k].x)*(point.x-_centers[k].x) + (point.y-_centers[k].y)*(point.y-_centers[k].y));
-  	    totalW += w;
-  	    prob += w*_classifiers[ _cell_neighbours[cell_idx][k] ] .getProb(in_ptr[x] );
-	  }
-   	  prob /= totalW;
-//    prob/=float(_classifiers.size()-17);
+	uchar *_mask_ptr=_mask.ptr<uchar>(y);
+	double X = r.x*H[0] + y*H[1] + H[2];
+	double Y = r.x*H[3] + y*H[4] + H[5];
+	double Z = r.x*H[6] + y*H[7] + H[8];
+	for(int x=r.x; x<r.x+r.width; x++, X+=H[0], Y+=H[3], Z+=H[6]) {
+	  double invZ = 1./Z;
+	  double u = X*invZ, v = Y*invZ;
+	  if(!(u>=0. && v>=0. && u<mc && v<nc)) continue;	// also skips NaN (X = Z = 0)
+	  int cx = int(u), cy = int(v);
+	  int sx = std::min(int((u-cx)*_subCells), _subCells-1);
+	  int sy = std::min(int((v-cy)*_subCells), _subCells-1);
+ 	  size_t cell_idx=cy*mc+cx;
+	  const vector<size_t> &neighbours = _cell_neighbours[cell_idx];
+	  const float *w = weights + (_cellLayout[cell_idx]*nbins + sy*_subCells + sx)*9;
+	  uchar val = in_ptr[x];
+	  float prob=0.0;
+	  for(size_t k=0; k<neighbours.size(); k++)
+	    prob += w[k]*_classifiers[ neighbours[k] ].getProb(val);
 	  if(prob > _threshProb) {
 	    _mask_ptr[x]=1;
 	  }
 	}
       }
-//     // apply closing to mask
-// _mask=_maskAux;
-   cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3,3));
-   cv::morphologyEx(_maskAux,_mask, CV_MOP_CLOSE, element);  
 }
 
 
 
 void ChromaticMask::update(const cv::Mat& in)
 {
+  if(_online) {
+    updateOnline(in);
+    return;
+  }
+  
   cv::Mat maskCells;
   maskCells = _cellMap.mul(_mask);
   
@@ -442,6 +614,47 @@ void ChromaticMask::update(const cv::Mat& in)
 
 
 
+/**
+ */
+void ChromaticMask::updateOnline(const cv::Mat& in)
+{
+  std::fill(_cellCounts.begin(), _cellCounts.end(), 0);
+  
+  // one pass over the image: count intensities of the masked pixels per cell
+  unsigned int *counts = &_cellCounts[0];
+  for(int i=0; i<in.rows; i++) {
+    const uchar* in_ptr = in.ptr<uchar>(i);
+    const uchar* mask_ptr = _mask.ptr<uchar>(i);
+    const uchar* cell_ptr = _cellMap.ptr<uchar>(i);
+    for(int j=0; j<in.cols; j++) {
+      if(mask_ptr[j]!=0 && cell_ptr[j]!=0) counts[ (cell_ptr[j]-1)*256 + in_ptr[j] ]++;
+    }
+  }
+  
+  double frameHist[256];
+  for(unsigned int c=0; c<_classifiers.size(); c++) {
+    const unsigned int *cellCounts = counts + c*256;
+    unsigned int n=0;
+    for(unsigned int i=0; i<256; i++) n += cellCounts[i];
+    if(n <= 50) continue;	// same minimum as the batch update
+    
+    EMClassifier::smoothHistogram(cellCounts, frameHist);
+    
+    double *hist = &_cellHist[c*256];
+    double sum=0.;
+    for(unsigned int i=0; i<256; i++) sum += hist[i];
+    if(sum==0.) {
+      std::copy(frameHist, frameHist+256, hist);
+    } else {
+      for(unsigned int i=0; i<256; i++) hist[i] = (1.-_decay)*hist[i] + _decay*frameHist[i];
+    }
+    
+    if(_classifiers[c].drift(hist) > _driftThresh) _classifiers[c].train(hist);
+  }
+}
+
+
+
 void ChromaticMask::resetMask()
 {
   
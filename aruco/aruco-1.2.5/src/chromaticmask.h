@@ -46,21 +46,30 @@ public:
   void addSample(uchar s) { _samples.push_back(s); };
   void clearSamples() { _samples.clear();  } ;
   void train();
+  void train(const double *histogram);
+  double drift(const double *histogram) const;
+  const double *getHistogram() const { return _histogram; };
   bool classify(uchar s) { return _inside[s]; };
   double getProb(uchar s) { return _prob[s]; };
   unsigned int numsamples() {return _samples.size();};
   void setProb(double p) { _threshProb = p; }
   
+  static void smoothHistogram(const unsigned int *counts, double *histogram);
+  
 //   double probConj[256];
   
 private:
-  cv::EM _classifier;
+  void fitHistogram();
+  
   vector<uchar> _samples;
   bool _inside[256];
   double _prob[256];
   double _histogram[256];
   unsigned int _nelem;
   double _threshProb;
+  
+  // two-component gaussian mixture fitted to _histogram
+  double _weight[2], _mean[2], _var[2];
 
 };
 
@@ -69,12 +78,21 @@ class ARUCO_EXPORTS ChromaticMask
 {
 public:
   
-  ChromaticMask() : _cellSize(20) { _isValid=false; };
+  ChromaticMask() : _cellSize(20) { _isValid=false; _gridValid=false; _gridReuseThresh=0.5f; _online=false; _decay=0.05; _driftThresh=0.1; };
   
   void setParams(unsigned int mc, unsigned int nc, double threshProb, aruco::CameraParameters CP, aruco::BoardConfiguration BC, vector<cv::Point3f> corners);
   void setParams(unsigned int mc, unsigned int nc, double threshProb, aruco::CameraParameters CP, aruco::BoardConfiguration BC, float markersize=-1.);
   
+  /**Enables online adaptation in update(): each cell keeps an exponentially decayed histogram
+   * (decay is the weight of the newest frame) and its mixture is re-fitted only when the
+   * L1 distance to the histogram it was last fitted on exceeds driftThresh
+   */
+  void setOnlineParams(bool online, double decay=0.05, double driftThresh=0.1) { _online=online; _decay=decay; _driftThresh=driftThresh; };
+  
   void calculateGridImage(const aruco::Board &board);
+  /**The cell map is reused while no projected board corner moves more than px pixels
+   */
+  void setGridReuseThreshold(float px) { _gridReuseThresh=px; };
   
   cv::Mat getCellMap() { return _cellMap; };
   cv::Mat getMask() { return _mask; };
@@ -89,6 +107,9 @@ public:
   
 private:
   
+  void calculateNeighbourWeights();
+  void updateOnline(const cv::Mat& in);
+  
   double getDistance(cv::Point2d pixel, unsigned int classifier) {
     cv::Vec2b canPos = _canonicalPos.at<cv::Vec2b>(pixel.y, pixel.x)[0];
     return norm(_cellCenters[classifier] - cv::Point2f(canPos[0], canPos[1]) );
@@ -99,18 +120,36 @@ private:
   cv::Mat _perpTrans;
   vector<EMClassifier> _classifiers;
   vector<cv::Point2f> _centers;
-  vector<cv::Point2f> _pixelsVector;
   vector<cv::Point2f> _cellCenters;
   vector<vector<size_t> > _cell_neighbours;
   const float _cellSize;
+  
+  // classify2 quantises the position inside a cell into _subCells x _subCells bins;
+  // _neighbourWeights holds, for each neighbour layout and bin, the normalised weights
+  // of the cells in _cell_neighbours (in the same order)
+  static const int _subCells = 8;
+  vector<float> _neighbourWeights;
+  vector<uchar> _cellLayout;
 
   
   unsigned int _mc, _nc;
   aruco::BoardDetector _BD;
   aruco::CameraParameters _CP;
-  cv::Mat _canonicalPos, _cellMap, _mask,_maskAux;
+  cv::Mat _canonicalPos, _cellMap, _mask;
   bool _isValid;
   double _threshProb;
+  
+  // board corners and bounding rect the current _cellMap was rasterised for
+  vector<cv::Point2f> _gridCornerPoints;
+  cv::Rect _gridRect;
+  bool _gridValid;
+  float _gridReuseThresh;
+  
+  // online adaptation: 256 bins per cell, stored contiguously
+  bool _online;
+  double _decay, _driftThresh;
+  vector<double> _cellHist;
+  vector<unsigned int> _cellCounts;
 
 
   
@@ -0,0 +1,325 @@
+#include "framelog.h"
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+namespace aruco
+{
+
+//file layout, see framelog.h
+static const char MAGIC[8]={'A','R','U','C','O','L','O','G'};
+static const unsigned int VERSION=1;
+static const unsigned int BYTE_ORDER_MARK=0x01020304;
+static const size_t ALIGNMENT=16;
+
+struct FileHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int bom;
+};
+
+struct ChunkHeader {
+    char tag[4];
+    unsigned int size;
+};
+
+struct CampHeader {
+    int width,height;
+    int ndistorsion;
+    float cameraMatrix[9];
+    float distorsion[8];
+};
+
+struct FramHeader {
+    int64 timestamp;
+    int width,height;
+    int type;
+    int step;
+};
+
+struct GtmkHeader {
+    int count;
+    int reserved;
+};
+
+struct GtmkMarker {
+    int id;
+    float ssize;
+    float corners[8];
+    float rvec[3];
+    float tvec[3];
+};
+
+static size_t padding(size_t offset)
+{
+    return (ALIGNMENT-offset%ALIGNMENT)%ALIGNMENT;
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+FrameLogWriter::FrameLogWriter()
+{
+    _file=NULL;
+}
+
+FrameLogWriter::~FrameLogWriter()
+{
+    close();
+}
+
+bool FrameLogWriter::open(const std::string &path)
+{
+    close();
+    _file=fopen(path.c_str(),"wb");
+    if (!_file) return false;
+    FileHeader header;
+    memcpy(header.magic,MAGIC,8);
+    header.version=VERSION;
+    header.bom=BYTE_ORDER_MARK;
+    if (fwrite(&header,sizeof(header),1,_file)!=1) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void FrameLogWriter::close()
+{
+    if (_file) fclose(_file);
+    _file=NULL;
+}
+
+void FrameLogWriter::writeChunk(const char tag[4],const void *header,size_t headerSize,const void *data,size_t dataSize,size_t dataStep,size_t rows)throw(cv::Exception)
+{
+    if (!_file) throw cv::Exception(9001,"frame log is not open","FrameLogWriter::writeChunk",__FILE__,__LINE__);
+    ChunkHeader chunk;
+    memcpy(chunk.tag,tag,4);
+    chunk.size=(unsigned int)(headerSize+dataSize*rows);
+    bool ok=fwrite(&chunk,sizeof(chunk),1,_file)==1 && fwrite(header,headerSize,1,_file)==1;
+    for (size_t r=0;ok && r<rows;r++)
+        ok=dataSize==0 || fwrite((const char*)data+r*dataStep,dataSize,1,_file)==1;
+    static const char zeros[ALIGNMENT]={0};
+    size_t pad=padding(sizeof(chunk)+chunk.size);
+    if (ok && pad) ok=fwrite(zeros,pad,1,_file)==1;
+    if (!ok) throw cv::Exception(9001,"could not write to frame log","FrameLogWriter::writeChunk",__FILE__,__LINE__);
+}
+
+void FrameLogWriter::writeCameraParameters(const CameraParameters &CP)throw(cv::Exception)
+{
+    if (!CP.isValid()) throw cv::Exception(9001,"invalid camera parameters","FrameLogWriter::writeCameraParameters",__FILE__,__LINE__);
+    CampHeader camp;
+    memset(&camp,0,sizeof(camp));
+    camp.width=CP.CamSize.width;
+    camp.height=CP.CamSize.height;
+    cv::Mat cm,dist;
+    CP.CameraMatrix.convertTo(cm,CV_32F);
+    CP.Distorsion.convertTo(dist,CV_32F);
+    for (int i=0;i<9;i++) camp.cameraMatrix[i]=cm.at<float>(i/3,i%3);
+    camp.ndistorsion=std::min((int)dist.total(),8);
+    for (int i=0;i<camp.ndistorsion;i++) camp.distorsion[i]=dist.ptr<float>(0)[i];
+    writeChunk("CAMP",&camp,sizeof(camp),NULL,0,0,0);
+}
+
+void FrameLogWriter::writeFrame(const cv::Mat &image,long long timestamp)throw(cv::Exception)
+{
+    if (image.type()!=CV_8UC1 && image.type()!=CV_8UC3) throw cv::Exception(9001,"frames must be CV_8UC1 or CV_8UC3","FrameLogWriter::writeFrame",__FILE__,__LINE__);
+    FramHeader fram;
+    fram.timestamp=timestamp;
+    fram.width=image.cols;
+    fram.height=image.rows;
+    fram.type=image.type();
+    fram.step=(int)(image.cols*image.elemSize());
+    //the pixels start 16 byte aligned: chunks are aligned, and the headers are 8+24 bytes
+    writeChunk("FRAM",&fram,sizeof(fram),image.data,fram.step,image.step,image.rows);
+}
+
+void FrameLogWriter::writeMarkers(const vector<Marker> &markers)throw(cv::Exception)
+{
+    GtmkHeader gtmk;
+    gtmk.count=(int)markers.size();
+    gtmk.reserved=0;
+    vector<GtmkMarker> out(markers.size());
+    for (size_t i=0;i<markers.size();i++) {
+        const Marker &m=markers[i];
+        GtmkMarker &g=out[i];
+        memset(&g,0,sizeof(g));
+        g.id=m.id;
+        g.ssize=m.ssize;
+        for (size_t c=0;c<4 && c<m.size();c++) {
+            g.corners[2*c]=m[c].x;
+            g.corners[2*c+1]=m[c].y;
+        }
+        for (int k=0;k<3;k++) {
+            if (m.Rvec.total()==3) g.rvec[k]=m.Rvec.ptr<float>(0)[k];
+            if (m.Tvec.total()==3) g.tvec[k]=m.Tvec.ptr<float>(0)[k];
+        }
+    }
+    writeChunk("GTMK",&gtmk,sizeof(gtmk),out.empty()?NULL:&out[0],out.size()*sizeof(GtmkMarker),0,1);
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+FrameLogReader::FrameLogReader()
+{
+    _data=NULL;
+    _size=0;
+    _mapping=NULL;
+}
+
+FrameLogReader::~FrameLogReader()
+{
+    close();
+}
+
+bool FrameLogReader::open(const std::string &path)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file=CreateFileA(path.c_str(),GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+    if (file==INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file,&size) || size.QuadPart==0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping=CreateFileMapping(file,NULL,PAGE_WRITECOPY,0,0,NULL);
+    CloseHandle(file);
+    if (!mapping) return false;
+    void *data=MapViewOfFile(mapping,FILE_MAP_COPY,0,0,0);
+    if (!data) {
+        CloseHandle(mapping);
+        return false;
+    }
+    _mapping=mapping;
+    _size=(size_t)size.QuadPart;
+#else
+    int fd=::open(path.c_str(),O_RDONLY);
+    if (fd<0) return false;
+    struct stat st;
+    if (fstat(fd,&st)!=0 || st.st_size==0) {
+        ::close(fd);
+        return false;
+    }
+    void *data=mmap(NULL,st.st_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if (data==MAP_FAILED) return false;
+    _size=st.st_size;
+#endif
+    _data=(unsigned char*)data;
+
+    //check the header, then index the chunks:
+    const FileHeader *header=(const FileHeader*)_data;
+    if (_size<sizeof(FileHeader) || memcmp(header->magic,MAGIC,8)!=0 || header->version!=VERSION || header->bom!=BYTE_ORDER_MARK) {
+        close();
+        return false;
+    }
+    size_t offset=sizeof(FileHeader);
+    int camp=-1;
+    while (offset+sizeof(ChunkHeader)<=_size) {
+        const ChunkHeader *chunk=(const ChunkHeader*)(_data+offset);
+        size_t payload=offset+sizeof(ChunkHeader);
+        if (chunk->size>_size-payload) break; //truncated, e.g. the writer was killed
+        if (memcmp(chunk->tag,"CAMP",4)==0 && chunk->size>=sizeof(CampHeader)) {
+            camp=(int)_camps.size();
+            _camps.push_back(payload);
+        }
+        else if (memcmp(chunk->tag,"FRAM",4)==0 && chunk->size>=sizeof(FramHeader)) {
+            const FramHeader *fram=(const FramHeader*)(_data+payload);
+            if (fram->width>0 && fram->height>0 && (fram->type==CV_8UC1 || fram->type==CV_8UC3)
+                    && fram->step>=fram->width*CV_ELEM_SIZE(fram->type)
+                    && (size_t)fram->step*fram->height<=chunk->size-sizeof(FramHeader)) {
+                FrameIndex index;
+                index.offset=payload;
+                index.camp=camp;
+                index.gtmk=0;
+                _frames.push_back(index);
+            }
+        }
+        else if (memcmp(chunk->tag,"GTMK",4)==0 && chunk->size>=sizeof(GtmkHeader) && !_frames.empty()) {
+            const GtmkHeader *gtmk=(const GtmkHeader*)(_data+payload);
+            if (gtmk->count>=0 && (size_t)gtmk->count<=(chunk->size-sizeof(GtmkHeader))/sizeof(GtmkMarker))
+                _frames.back().gtmk=payload;
+        }
+        //unknown chunks are skipped
+        offset=payload+chunk->size;
+        offset+=padding(offset);
+    }
+    return true;
+}
+
+void FrameLogReader::close()
+{
+    if (_data) {
+#ifdef _WIN32
+        UnmapViewOfFile(_data);
+        CloseHandle((HANDLE)_mapping);
+#else
+        munmap(_data,_size);
+#endif
+    }
+    _data=NULL;
+    _size=0;
+    _mapping=NULL;
+    _frames.clear();
+    _camps.clear();
+}
+
+cv::Mat FrameLogReader::image(size_t frame)const
+{
+    const FramHeader *fram=(const FramHeader*)(_data+_frames.at(frame).offset);
+    return cv::Mat(fram->height,fram->width,fram->type,(void*)(fram+1),fram->step);
+}
+
+long long FrameLogReader::timestamp(size_t frame)const
+{
+    return ((const FramHeader*)(_data+_frames.at(frame).offset))->timestamp;
+}
+
+bool FrameLogReader::cameraParameters(size_t frame,CameraParameters &CP)const
+{
+    int camp=_frames.at(frame).camp;
+    if (camp<0) return false;
+    const CampHeader *h=(const CampHeader*)(_data+_camps[camp]);
+    cv::Mat cm(3,3,CV_32F),dist(std::max(std::min(h->ndistorsion,8),4),1,CV_32F,cv::Scalar(0));
+    for (int i=0;i<9;i++) cm.at<float>(i/3,i%3)=h->cameraMatrix[i];
+    for (int i=0;i<dist.rows && i<h->ndistorsion;i++) dist.at<float>(i)=h->distorsion[i];
+    CP.setParams(cm,dist,cv::Size(h->width,h->height));
+    return true;
+}
+
+bool FrameLogReader::markers(size_t frame,vector<Marker> &markers)const
+{
+    size_t offset=_frames.at(frame).gtmk;
+    markers.clear();
+    if (!offset) return false;
+    const GtmkHeader *gtmk=(const GtmkHeader*)(_data+offset);
+    const GtmkMarker *g=(const GtmkMarker*)(gtmk+1);
+    markers.resize(gtmk->count);
+    for (int i=0;i<gtmk->count;i++,g++) {
+        Marker &m=markers[i];
+        m.id=g->id;
+        m.ssize=g->ssize;
+        m.resize(4);
+        for (int c=0;c<4;c++) m[c]=cv::Point2f(g->corners[2*c],g->corners[2*c+1]);
+        for (int k=0;k<3;k++) {
+            m.Rvec.at<float>(k,0)=g->rvec[k];
+            m.Tvec.at<float>(k,0)=g->tvec[k];
+        }
+    }
+    return true;
+}
+
+}
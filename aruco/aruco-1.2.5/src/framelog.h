@@ -0,0 +1,109 @@
+#ifndef _Aruco_FrameLog_H
+#define _Aruco_FrameLog_H
+#include <opencv2/core/core.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "exports.h"
+#include "cameraparameters.h"
+#include "marker.h"
+using namespace std;
+namespace aruco
+{
+
+/**\brief Chunked binary log of camera frames, for deterministic replay
+ *
+ * The file starts with a 16 byte header ("ARUCOLOG", version, byte order mark) followed by
+ * chunks, each made of a four character tag, a 32 bit payload size and the payload, padded
+ * so that the next chunk starts on a 16 byte boundary:
+ *
+ *  - CAMP: camera parameters (width, height, camera matrix, distorsion), which apply to
+ *    all the frames that follow
+ *  - FRAM: timestamp in microseconds, width, height, OpenCV type, row step, then the raw
+ *    pixels (grey or BGR), starting on a 16 byte boundary
+ *  - GTMK: markers of the preceding frame (ground truth, or a previous run's detections)
+ *
+ * Values are stored in the byte order of the writer; the reader refuses files of the other order.
+ */
+class ARUCO_EXPORTS FrameLogWriter
+{
+public:
+    FrameLogWriter();
+    ~FrameLogWriter();
+
+    /**Creates the file, truncating it if it exists
+     */
+    bool open(const std::string &path);
+    void close();
+    bool isOpen()const {return _file!=NULL;}
+
+    void writeCameraParameters(const CameraParameters &CP)throw(cv::Exception);
+    /**Writes a grey (CV_8UC1) or BGR (CV_8UC3) image, with its capture time
+     */
+    void writeFrame(const cv::Mat &image,long long timestamp)throw(cv::Exception);
+    /**Writes the markers found in the last frame written
+     */
+    void writeMarkers(const vector<Marker> &markers)throw(cv::Exception);
+
+private:
+    FrameLogWriter(const FrameLogWriter &);
+    FrameLogWriter & operator=(const FrameLogWriter &);
+
+    void writeChunk(const char tag[4],const void *header,size_t headerSize,const void *data,size_t dataSize,size_t dataStep,size_t rows)throw(cv::Exception);
+
+    FILE *_file;
+};
+
+/**\brief Memory mapped reader of a frame log
+ *
+ * The file is indexed when opened; frames are then returned as cv::Mat headers pointing into
+ * the mapping, so there is no decoding or copying while replaying. The mapping is private, so
+ * anything written to a frame stays in this process.
+ */
+class ARUCO_EXPORTS FrameLogReader
+{
+public:
+    FrameLogReader();
+    ~FrameLogReader();
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen()const {return _data!=NULL;}
+
+    /**Number of frames in the log
+     */
+    size_t size()const {return _frames.size();}
+
+    /**The image of a frame, valid until the log is closed
+     */
+    cv::Mat image(size_t frame)const;
+    long long timestamp(size_t frame)const;
+    /**The camera parameters in effect for a frame; false if there are none
+     */
+    bool cameraParameters(size_t frame,CameraParameters &CP)const;
+    /**Which CAMP chunk applies to a frame (-1 for none), to tell when the camera model changes
+     */
+    int cameraParametersIndex(size_t frame)const {return _frames.at(frame).camp;}
+    /**The markers recorded for a frame; false if there are none
+     */
+    bool markers(size_t frame,vector<Marker> &markers)const;
+
+private:
+    FrameLogReader(const FrameLogReader &);
+    FrameLogReader & operator=(const FrameLogReader &);
+
+    struct FrameIndex {
+        size_t offset;  //of the FRAM payload
+        int camp;       //index into _camps, or -1
+        size_t gtmk;    //offset of the GTMK payload, or 0
+    };
+
+    unsigned char *_data;
+    size_t _size;
+    void *_mapping;
+    vector<FrameIndex> _frames;
+    vector<size_t> _camps;
+};
+
+}
+#endif
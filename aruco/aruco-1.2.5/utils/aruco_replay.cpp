@@ -0,0 +1,217 @@
+/*****************************************************************************************
+Replays a frame log (see framelog.h) through the detectors as fast as possible, reporting
+the throughput and a digest of the results, and checking them against the markers stored
+in the log. Recording the results with -rec gives a log to check a later build against:
+
+    aruco_replay show.alog -rec reference.alog
+    aruco_replay reference.alog                 (with the new build)
+********************************************************************************************/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include "aruco.h"
+#include "framelog.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+using namespace cv;
+using namespace aruco;
+
+string TheInputLog;
+string TheOutputLog;
+string TheIntrinsicFile;
+string TheBoardConfigFile;
+Size TheChessboardSize(0,0);
+float TheMarkerSize=-1;
+int ThePasses=1;
+bool Verbose=false;
+
+FrameLogReader TheLog;
+FrameLogWriter TheRecorder;
+CameraParameters TheCameraParameters;
+MarkerDetector MDetector;
+BoardDetector TheBoardDetector;
+BoardConfiguration TheBoardConfig;
+vector<Marker> TheMarkers,TheExpectedMarkers;
+vector<Point2f> TheCorners;
+Mat TheGrey;
+
+int findParam ( std::string param,int argc, char *argv[] )
+{
+    for ( int i=0; i<argc; i++ )
+        if ( string ( argv[i] ) ==param ) return i;
+
+    return -1;
+
+}
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+bool readArguments ( int argc,char **argv )
+{
+    if (argc<2) {
+        cerr<<"Invalid number of arguments"<<endl;
+        cerr<<"Usage: in.alog [-size markersize] [-intrinsics intrinsics.yml] [-board board.yml | -chessboard WxH] [-n passes] [-rec out.alog] [-v]"<<endl;
+        return false;
+    }
+    TheInputLog=argv[1];
+    int i;
+    if ((i=findParam("-size",argc,argv))!=-1 && i+1<argc) TheMarkerSize=atof(argv[i+1]);
+    if ((i=findParam("-intrinsics",argc,argv))!=-1 && i+1<argc) TheIntrinsicFile=argv[i+1];
+    if ((i=findParam("-board",argc,argv))!=-1 && i+1<argc) TheBoardConfigFile=argv[i+1];
+    if ((i=findParam("-chessboard",argc,argv))!=-1 && i+1<argc) sscanf(argv[i+1],"%dx%d",&TheChessboardSize.width,&TheChessboardSize.height);
+    if ((i=findParam("-n",argc,argv))!=-1 && i+1<argc) ThePasses=std::max(1,atoi(argv[i+1]));
+    if ((i=findParam("-rec",argc,argv))!=-1 && i+1<argc) TheOutputLog=argv[i+1];
+    Verbose=findParam("-v",argc,argv)!=-1;
+    return true;
+}
+
+//FNV-1a, over the bits of the results
+unsigned long long digest(unsigned long long h,const void *data,size_t size)
+{
+    const unsigned char *p=(const unsigned char*)data;
+    for (size_t i=0;i<size;i++) h=(h^p[i])*1099511628211ULL;
+    return h;
+}
+
+unsigned long long digest(unsigned long long h,const vector<Marker> &markers)
+{
+    for (unsigned int i=0;i<markers.size();i++) {
+        const Marker &m=markers[i];
+        h=digest(h,&m.id,sizeof(m.id));
+        if (!m.empty()) h=digest(h,&m[0],m.size()*sizeof(Point2f));
+        if (m.Rvec.total()==3) h=digest(h,m.Rvec.ptr<float>(0),3*sizeof(float));
+        if (m.Tvec.total()==3) h=digest(h,m.Tvec.ptr<float>(0),3*sizeof(float));
+    }
+    return h;
+}
+
+//bit-for-bit comparison with the markers stored in the log
+bool sameMarkers(const vector<Marker> &a,const vector<Marker> &b)
+{
+    if (a.size()!=b.size()) return false;
+    for (unsigned int i=0;i<a.size();i++) {
+        if (a[i].id!=b[i].id || a[i].size()!=b[i].size()) return false;
+        if (!a[i].empty() && memcmp(&a[i][0],&b[i][0],a[i].size()*sizeof(Point2f))!=0) return false;
+        if (a[i].Rvec.total()==3 && b[i].Rvec.total()==3 && memcmp(a[i].Rvec.ptr<float>(0),b[i].Rvec.ptr<float>(0),3*sizeof(float))!=0) return false;
+        if (a[i].Tvec.total()==3 && b[i].Tvec.total()==3 && memcmp(a[i].Tvec.ptr<float>(0),b[i].Tvec.ptr<float>(0),3*sizeof(float))!=0) return false;
+    }
+    return true;
+}
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+int main(int argc,char **argv)
+{
+    try
+    {
+        if (readArguments (argc,argv)==false) {
+            return 0;
+        }
+        if (!TheLog.open(TheInputLog)) {
+            cerr<<"Could not open "<<TheInputLog<<endl;
+            return -1;
+        }
+        if (TheLog.size()==0) {
+            cerr<<"No frames in "<<TheInputLog<<endl;
+            return -1;
+        }
+        if (TheIntrinsicFile!="") {
+            TheCameraParameters.readFromXMLFile(TheIntrinsicFile);
+            TheCameraParameters.resize(TheLog.image(0).size());
+        }
+        if (TheBoardConfigFile!="") TheBoardConfig.readFromFile(TheBoardConfigFile);
+        if (TheOutputLog!="" && !TheRecorder.open(TheOutputLog)) {
+            cerr<<"Could not create "<<TheOutputLog<<endl;
+            return -1;
+        }
+
+        //the camera model changes only with a CAMP chunk (or not at all, with -intrinsics)
+        int lastCamp=-1;
+        bool configured=false;
+        double total=0;
+        int mismatches=0,checked=0;
+        unsigned long long hash=14695981039346656037ULL;
+        for (int pass=0;pass<ThePasses;pass++) {
+            for (size_t f=0;f<TheLog.size();f++) {
+                Mat image=TheLog.image(f);
+
+                if (TheIntrinsicFile=="" && TheLog.cameraParametersIndex(f)!=lastCamp) {
+                    lastCamp=TheLog.cameraParametersIndex(f);
+                    TheLog.cameraParameters(f,TheCameraParameters);
+                    TheCameraParameters.resize(image.size());
+                    configured=false;
+                }
+                bool newModel=!configured;
+                if (newModel && TheBoardConfigFile!="") {
+                    if (TheCameraParameters.isValid()) TheBoardDetector.setParams(TheBoardConfig,TheCameraParameters,TheMarkerSize);
+                    else TheBoardDetector.setParams(TheBoardConfig);
+                }
+                configured=true;
+
+                double tick=(double)getTickCount();
+                if (TheChessboardSize.area()>0) {
+                    //as findchessboard does it
+                    if (image.channels()!=1) cvtColor(image,TheGrey,CV_BGR2GRAY);
+                    else TheGrey=image;
+                    TheCorners.clear();
+                    if (findChessboardCorners(TheGrey,TheChessboardSize,TheCorners,CV_CALIB_CB_ADAPTIVE_THRESH|CV_CALIB_CB_NORMALIZE_IMAGE|CV_CALIB_CB_FAST_CHECK))
+                        cornerSubPix(TheGrey,TheCorners,Size(11,11),Size(-1,-1),TermCriteria(CV_TERMCRIT_EPS+CV_TERMCRIT_ITER,30,0.1));
+                }
+                else if (TheBoardConfigFile!="") {
+                    TheBoardDetector.detect(image);
+                    TheMarkers=TheBoardDetector.getDetectedMarkers();
+                }
+                else MDetector.detect(image,TheMarkers,TheCameraParameters,TheMarkerSize);
+                total+=((double)getTickCount()-tick)/getTickFrequency();
+
+                if (pass>0) continue;
+
+                //results:
+                if (TheChessboardSize.area()>0) {
+                    if (!TheCorners.empty()) hash=digest(hash,&TheCorners[0],TheCorners.size()*sizeof(Point2f));
+                }
+                else {
+                    hash=digest(hash,TheMarkers);
+                    if (TheBoardConfigFile!="") {
+                        Board &B=TheBoardDetector.getDetectedBoard();
+                        if (B.Rvec.total()==3) hash=digest(hash,B.Rvec.ptr<float>(0),3*sizeof(float));
+                        if (B.Tvec.total()==3) hash=digest(hash,B.Tvec.ptr<float>(0),3*sizeof(float));
+                    }
+                    if (TheLog.markers(f,TheExpectedMarkers)) {
+                        checked++;
+                        if (!sameMarkers(TheMarkers,TheExpectedMarkers)) {
+                            mismatches++;
+                            if (Verbose) cout<<"frame "<<f<<": "<<TheMarkers.size()<<" markers, expected "<<TheExpectedMarkers.size()<<endl;
+                        }
+                    }
+                }
+                if (TheRecorder.isOpen()) {
+                    if (newModel && TheCameraParameters.isValid()) TheRecorder.writeCameraParameters(TheCameraParameters);
+                    TheRecorder.writeFrame(image,TheLog.timestamp(f));
+                    if (TheChessboardSize.area()==0) TheRecorder.writeMarkers(TheMarkers);
+                }
+            }
+        }
+        TheRecorder.close();
+
+        size_t frames=TheLog.size()*ThePasses;
+        cout<<frames<<" frames in "<<total<<" s: "<<1000*total/frames<<" ms per frame, "<<frames/total<<" fps"<<endl;
+        cout<<"digest "<<std::hex<<hash<<std::dec<<endl;
+        if (checked) cout<<checked-mismatches<<" of "<<checked<<" frames match the recorded markers"<<endl;
+        return mismatches?1:0;
+
+    } catch (std::exception &ex)
+
+    {
+        cout<<"Exception :"<<ex.what()<<endl;
+        return -1;
+    }
+
+}
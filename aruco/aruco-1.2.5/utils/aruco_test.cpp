@@ -30,6 +30,7 @@ or implied, of Rafael Muñoz Salinas.
 #include <sstream>
 #include "aruco.h"
 #include "cvdrawingutils.h"
+#include "framelog.h"
 #include <opencv2/highgui/highgui.hpp>
 using namespace cv;
 using namespace aruco;
@@ -43,8 +44,10 @@ VideoCapture TheVideoCapturer;
 vector<Marker> TheMarkers;
 Mat TheInputImage,TheInputImageCopy;
 CameraParameters TheCameraParameters;
+FrameLogWriter TheRecorder;
 void cvTackBarEvents(int pos,void*);
 bool readCameraParameters(string TheIntrinsicFile,CameraParameters &CP,Size size);
+int findParam ( std::string param,int argc, char *argv[] );
 
 pair<double,double> AvrgTime(0,0) ;//determines the average time required for detection
 double ThresParam1,ThresParam2;
@@ -61,9 +64,18 @@ bool readArguments ( int argc,char **argv )
 {
     if (argc<2) {
         cerr<<"Invalid number of arguments"<<endl;
-        cerr<<"Usage: (in.avi|live[:idx_cam=0]) [intrinsics.yml] [size]"<<endl;
+        cerr<<"Usage: (in.avi|live[:idx_cam=0]) [intrinsics.yml] [size] [-rec out.alog]"<<endl;
         return false;
     }
+    //record the frames & detections, for aruco_replay:
+    int rec=findParam("-rec",argc,argv);
+    if (rec!=-1) {
+        if (rec+1>=argc || !TheRecorder.open(argv[rec+1])) {
+            cerr<<"Could not create the frame log"<<endl;
+            return false;
+        }
+        argc=rec;
+    }
     TheInputVideo=argv[1];
      if (argc>=3)
          TheIntrinsicFile=argv[2];
@@ -127,6 +139,8 @@ int main(int argc,char **argv)
             TheCameraParameters.readFromXMLFile(TheIntrinsicFile);
             TheCameraParameters.resize(TheInputImage.size());
         }
+        if (TheRecorder.isOpen() && TheCameraParameters.isValid())
+            TheRecorder.writeCameraParameters(TheCameraParameters);
         //Configure other parameters
         if (ThePyrDownLevel>0)
             MDetector.pyrDown(ThePyrDownLevel);
@@ -158,6 +172,10 @@ int main(int argc,char **argv)
             //chekc the speed by calculating the mean speed of all iterations
             AvrgTime.first+=((double)getTickCount()-tick)/getTickFrequency();
             AvrgTime.second++;
+            if (TheRecorder.isOpen()) {
+                TheRecorder.writeFrame(TheInputImage,(long long)(tick*1e6/getTickFrequency()));
+                TheRecorder.writeMarkers(TheMarkers);
+            }
             cout<<"\rTime detection="<<1000*AvrgTime.first/AvrgTime.second<<" milliseconds nmarkers="<<TheMarkers.size()<< std::flush;
 
             //print marker info and draw the markers in image
@@ -1,7 +1,9 @@
 #include "aruco.h"
 #include "cvdrawingutils.h"
+#include "framelog.h"
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
 
 #ifdef __cplusplus 
 extern "C" {
@@ -14,14 +16,90 @@ extern "C" {
 }
 #endif
 
+#include "../common/jit_opencv.h"
+
 #include <new>
 #include <vector>
+#include <math.h>
 
 
 t_class * aruco_class;
 
 volatile int libcount = 0;
 
+class t_aruco;
+void *aruco_worker(t_aruco *x);
+
+// one grey frame handed to the worker thread, with the settings to detect it with:
+struct t_aruco_frame {
+	enum { FREE, FILLING, PENDING, BUSY };
+	int state;
+	cv::Mat grey;
+	aruco::CameraParameters params;
+	float markersize;
+	int use_calibration;
+};
+
+// one complete detection result:
+struct t_aruco_result {
+	std::vector<aruco::Marker> markers;
+	std::vector<float> errors;
+};
+
+// marker matrix layout, one float32 cell per marker:
+enum {
+	MARKER_ID = 0,
+	MARKER_CORNERS = 1,		// x, y of the 4 corners
+	MARKER_TVEC = 9,
+	MARKER_QUAT = 12,		// x, y, z, w
+	MARKER_ERROR = 16,		// RMS reprojection error in pixels
+	MARKER_PLANES = 17
+};
+
+// aruco::Marker fills Rvec & Tvec with -999999 until its pose has been estimated:
+static bool aruco_has_pose(const aruco::Marker& m) {
+	return !m.Rvec.empty() && !m.Tvec.empty()
+		&& m.Rvec.at<float>(0) != -999999 && m.Tvec.at<float>(0) != -999999;
+}
+
+// RMS reprojection error of each marker's corners, given its pose
+// (zero when no pose was estimated):
+static void aruco_reprojection_errors(const std::vector<aruco::Marker>& markers, const aruco::CameraParameters& params, std::vector<float>& errors) {
+	errors.assign(markers.size(), 0.f);
+	if (!params.isValid()) return;
+	
+	std::vector<cv::Point3f> object(4);
+	std::vector<cv::Point2f> projected;
+	for (unsigned int i=0; i<markers.size(); i++) {
+		const aruco::Marker& m = markers[i];
+		if (!m.isValid() || m.size() != 4 || m.ssize <= 0 || !aruco_has_pose(m)) continue;
+		
+		// same corner order as Marker::calculateExtrinsics:
+		float h = m.ssize * 0.5f;
+		object[0] = cv::Point3f(-h, h, 0);
+		object[1] = cv::Point3f( h, h, 0);
+		object[2] = cv::Point3f( h,-h, 0);
+		object[3] = cv::Point3f(-h,-h, 0);
+		cv::projectPoints(object, m.Rvec, m.Tvec, params.CameraMatrix, params.Distorsion, projected);
+		
+		double sum = 0;
+		for (int c=0; c<4; c++) {
+			cv::Point2f d = projected[c] - m[c];
+			sum += d.dot(d);
+		}
+		errors[i] = (float)sqrt(sum / 4.);
+	}
+}
+
+// atomic exchange of a 32-bit value:
+static long aruco_exchange(t_int32_atomic * p, long v) {
+	long old;
+	do {
+		old = *p;
+	} while (!ATOMIC_COMPARE_SWAP32(old, v, p));
+	return old;
+}
+
 class t_aruco {
 public:
 	t_object	ob;			// the object itself (must be first)
@@ -30,6 +108,17 @@ public:
 	void *		outlet_msg;
 	void *		outlet_img;
 	void *		outlet_c;
+	void *		outlet_markers;
+	
+	// markers matrix:
+	void *		markers_mat;
+	void *		markers_mat_wrapper;
+	t_atom		markers_mat_name[1];
+	
+	// annotated copy of the input:
+	void *		overlay_mat;
+	void *		overlay_mat_wrapper;
+	t_atom		overlay_mat_name[1];
 	
 	// attrs:
 	float		markersize;
@@ -37,15 +126,83 @@ public:
 	float		camera_intrinsic[9];
 	
 	int			use_calibration;
+	int			async;
+	int			lists;
+	int			overlay;
+	t_symbol *	record;
 	
 	aruco::MarkerDetector MDetector;
 	std::vector<aruco::Marker> Markers;
+	std::vector<float> Errors;
+	cv::Mat Grey;
 	
 	cv::Mat cvIntrinsic, cvDistortion;
 	
+	// camera model, rebuilt only when the calibration attrs or input size change:
+	aruco::CameraParameters CParams;
+	cv::Size params_size;
+	int params_dirty;
+	
+	// frame log of the input, for replaying through aruco_replay:
+	aruco::FrameLogWriter Recorder;
+	int record_params;
+	
+	// async detection: frames are double-buffered on the way in...
+	t_systhread worker;
+	t_systhread_mutex worker_mutex;
+	t_systhread_cond worker_cond;
+	int worker_quit;
+	t_aruco_frame frames[2];
+	aruco::MarkerDetector AsyncDetector;
+	
+	// ...and results come back through a lock-free triple buffer: the worker owns
+	// results[result_back], the Max thread owns results[result_front], and
+	// result_state holds the index of the latest complete result (+ RESULT_FRESH
+	// if it has not been taken yet)
+	enum { RESULT_FRESH = 4 };
+	t_aruco_result results[3];
+	int result_back, result_front;
+	t_int32_atomic result_state;
+	
 	t_aruco() {
 		markersize = 0.1f;
 		use_calibration = 1;
+		async = 0;
+		lists = 1;
+		overlay = 0;
+		params_dirty = 1;
+		record = gensym("");
+		record_params = 1;
+		
+		// create the markers matrix:
+		t_jit_matrix_info info;
+		
+		markers_mat_wrapper = jit_object_new(gensym("jit_matrix_wrapper"), jit_symbol_unique(), 0, NULL);
+		markers_mat = jit_object_method(markers_mat_wrapper, _jit_sym_getmatrix);
+		jit_matrix_info_default(&info);
+		info.flags |= JIT_MATRIX_DATA_PACK_TIGHT;
+		info.planecount = MARKER_PLANES;
+		info.type = gensym("float32");
+		info.dimcount = 1;
+		info.dim[0] = 1;
+		jit_object_method(markers_mat, _jit_sym_setinfo_ex, &info);
+		jit_object_method(markers_mat, _jit_sym_clear);
+		// cache name:
+		atom_setsym(markers_mat_name, jit_attr_getsym(markers_mat_wrapper, _jit_sym_name));
+		
+		// the overlay matrix takes its size from the input:
+		overlay_mat_wrapper = jit_object_new(gensym("jit_matrix_wrapper"), jit_symbol_unique(), 0, NULL);
+		overlay_mat = jit_object_method(overlay_mat_wrapper, _jit_sym_getmatrix);
+		atom_setsym(overlay_mat_name, jit_attr_getsym(overlay_mat_wrapper, _jit_sym_name));
+		
+		worker = 0;
+		worker_quit = 0;
+		systhread_mutex_new(&worker_mutex, 0);
+		systhread_cond_new(&worker_cond, 0);
+		for (int i=0; i<2; i++) frames[i].state = t_aruco_frame::FREE;
+		result_back = 0;
+		result_state = 1;
+		result_front = 2;
 		
 		cvIntrinsic = cv::Mat(3, 3, CV_32F, camera_intrinsic);
 		cvIntrinsic = 0.f;
@@ -60,12 +217,150 @@ public:
 	}
 
 	~t_aruco() {
+		unsigned int ret;
+		
+		if (worker) {
+			systhread_mutex_lock(worker_mutex);
+			worker_quit = 1;
+			systhread_cond_signal(worker_cond);
+			systhread_mutex_unlock(worker_mutex);
+			systhread_join(worker, &ret);
+		}
+		systhread_cond_free(worker_cond);
+		systhread_mutex_free(worker_mutex);
+		
+		if (markers_mat_wrapper) {
+			object_free(markers_mat_wrapper);
+			markers_mat_wrapper = NULL;
+		}
+		if (overlay_mat_wrapper) {
+			object_free(overlay_mat_wrapper);
+			overlay_mat_wrapper = NULL;
+		}
+	}
+	
+	// rebuild the camera model if the calibration or image size has changed:
+	void update_params(cv::Size size) {
+		if (!params_dirty && size == params_size) return;
+		
+		// copies, so that the attrs can change while the worker holds a model:
+		CParams.setParams(cvIntrinsic.clone(), cvDistortion.clone(), size);
+		params_size = size;
+		params_dirty = 0;
+		record_params = 1;
+	}
+	
+	// start or stop recording (an empty name stops):
+	void set_record(t_symbol * path) {
+		Recorder.close();
+		record = gensym("");
+		if (!path || !path->s_name[0]) return;
+		
+		if (!Recorder.open(path->s_name)) {
+			object_error(&ob, "could not create frame log %s", path->s_name);
+			return;
+		}
+		record = path;
+		record_params = 1;
+	}
+	
+	// append the detector's input & its result to the frame log:
+	void record_frame(const cv::Mat& grey) {
+		if (record_params && use_calibration && CParams.isValid()) Recorder.writeCameraParameters(CParams);
+		record_params = 0;
+		Recorder.writeFrame(grey, (long long)(cv::getTickCount() * 1e6 / cv::getTickFrequency()));
+		Recorder.writeMarkers(Markers);
+	}
+	
+	// worker thread: detect pending frames until asked to quit
+	void work() {
+		while (1) {
+			t_aruco_frame * frame = 0;
+			
+			systhread_mutex_lock(worker_mutex);
+			while (!worker_quit && !frame) {
+				for (int i=0; i<2; i++) {
+					if (frames[i].state == t_aruco_frame::PENDING) frame = &frames[i];
+				}
+				if (!frame) systhread_cond_wait(worker_cond, worker_mutex);
+			}
+			if (worker_quit) {
+				systhread_mutex_unlock(worker_mutex);
+				return;
+			}
+			frame->state = t_aruco_frame::BUSY;
+			systhread_mutex_unlock(worker_mutex);
+			
+			t_aruco_result& result = results[result_back];
+			try {
+				if (frame->use_calibration) {
+					AsyncDetector.detect(frame->grey, result.markers, frame->params, frame->markersize, false);
+					aruco_reprojection_errors(result.markers, frame->params, result.errors);
+				} else {
+					AsyncDetector.detect(frame->grey, result.markers);
+					result.errors.assign(result.markers.size(), 0.f);
+				}
+				
+				// publish, and take over the buffer that held the previous result:
+				result_back = aruco_exchange(&result_state, result_back | RESULT_FRESH) & 3;
+			} catch (std::exception &ex) {
+				// can't post from here; the frame is simply dropped
+			}
+			
+			systhread_mutex_lock(worker_mutex);
+			frame->state = t_aruco_frame::FREE;
+			systhread_mutex_unlock(worker_mutex);
+		}
+	}
 	
+	// take the latest result from the worker, if there is a new one:
+	bool take_result() {
+		if (!(result_state & RESULT_FRESH)) return false;
+		result_front = aruco_exchange(&result_state, result_front) & 3;
+		Markers.swap(results[result_front].markers);
+		Errors.swap(results[result_front].errors);
+		return true;
+	}
+	
+	// hand a frame to the worker, unless it already has one waiting:
+	void submit(char * bp, const t_jit_matrix_info& info) {
+		t_aruco_frame * frame = 0;
+		
+		systhread_mutex_lock(worker_mutex);
+		bool waiting = false;
+		for (int i=0; i<2; i++) {
+			if (frames[i].state == t_aruco_frame::PENDING || frames[i].state == t_aruco_frame::FILLING) waiting = true;
+			else if (frames[i].state == t_aruco_frame::FREE) frame = &frames[i];
+		}
+		if (waiting) frame = 0;	// drop this one
+		if (frame) frame->state = t_aruco_frame::FILLING;
+		systhread_mutex_unlock(worker_mutex);
+		if (!frame) return;
+		
+		jit_cv::luma_into(bp, info, frame->grey);
+		update_params(cv::Size(jit_cv::width(info), jit_cv::height(info)));
+		frame->params = CParams;
+		frame->markersize = markersize;
+		frame->use_calibration = use_calibration;
+		
+		systhread_mutex_lock(worker_mutex);
+		frame->state = t_aruco_frame::PENDING;
+		if (!worker) systhread_create((method)aruco_worker, this, 0, 0, 0, &worker);
+		systhread_cond_signal(worker_cond);
+		systhread_mutex_unlock(worker_mutex);
 	}
 	
 	void bang() {
+		if (async) take_result();
+		output_markers();
+	}
+	
+	void output_markers() {
 		t_atom a[8];
 		
+		output_markers_matrix();
+		if (!lists) return;
+		
 		for (unsigned int i=0;i<Markers.size();i++) {
 			aruco::Marker& m = Markers[i];
 		
@@ -81,6 +376,81 @@ public:
 		}
 	}
 	
+	// write all markers into the markers matrix & send it as one message:
+	void output_markers_matrix() {
+		t_jit_matrix_info info;
+		char * bp;
+		long n = Markers.size();
+		
+		jit_object_method(markers_mat, _jit_sym_getinfo, &info);
+		if (info.dim[0] != (n ? n : 1)) {
+			info.flags |= JIT_MATRIX_DATA_PACK_TIGHT;
+			info.dim[0] = n ? n : 1;
+			jit_object_method(markers_mat, _jit_sym_setinfo_ex, &info);
+			jit_object_method(markers_mat, _jit_sym_getinfo, &info);
+		}
+		jit_object_method(markers_mat, _jit_sym_getdata, &bp);
+		if (!bp) return;
+		
+		if (n == 0) {
+			// a matrix can't be empty; mark the single cell as no marker:
+			float * cell = (float *)bp;
+			for (int p=0; p<MARKER_PLANES; p++) cell[p] = 0.f;
+			cell[MARKER_ID] = -1.f;
+		}
+		for (long i=0; i<n; i++) {
+			const aruco::Marker& m = Markers[i];
+			float * cell = (float *)(bp + i*info.dimstride[0]);
+			
+			cell[MARKER_ID] = m.id;
+			for (int c=0; c<4; c++) {
+				cell[MARKER_CORNERS + 2*c] = c < (int)m.size() ? m[c].x : 0.f;
+				cell[MARKER_CORNERS + 2*c + 1] = c < (int)m.size() ? m[c].y : 0.f;
+			}
+			
+			// quaternion from the Rodrigues vector:
+			float q[4] = { 0.f, 0.f, 0.f, 1.f };
+			if (aruco_has_pose(m)) {
+				for (int k=0; k<3; k++) cell[MARKER_TVEC + k] = m.Tvec.at<float>(k);
+				
+				double rx = m.Rvec.at<float>(0), ry = m.Rvec.at<float>(1), rz = m.Rvec.at<float>(2);
+				double angle = sqrt(rx*rx + ry*ry + rz*rz);
+				if (angle > 1e-9) {
+					double s = sin(angle * 0.5) / angle;
+					q[0] = rx * s;
+					q[1] = ry * s;
+					q[2] = rz * s;
+					q[3] = cos(angle * 0.5);
+				}
+			} else {
+				for (int k=0; k<3; k++) cell[MARKER_TVEC + k] = 0.f;
+			}
+			for (int k=0; k<4; k++) cell[MARKER_QUAT + k] = q[k];
+			
+			cell[MARKER_ERROR] = i < (long)Errors.size() ? Errors[i] : 0.f;
+		}
+		
+		outlet_anything(outlet_markers, _jit_sym_jit_matrix, 1, markers_mat_name);
+	}
+	
+	// copy the input into the overlay matrix, and wrap that for drawing:
+	cv::Mat copy_to_overlay(void * in_mat, const t_jit_matrix_info& in_info) {
+		t_jit_matrix_info info;
+		char * bp;
+		
+		jit_object_method(overlay_mat, _jit_sym_getinfo, &info);
+		if (info.planecount != in_info.planecount || info.dim[0] != in_info.dim[0] || info.dim[1] != in_info.dim[1]) {
+			info = in_info;
+			info.flags = JIT_MATRIX_DATA_PACK_TIGHT;
+			jit_object_method(overlay_mat, _jit_sym_setinfo_ex, &info);
+			jit_object_method(overlay_mat, _jit_sym_getinfo, &info);
+		}
+		jit_object_method(overlay_mat, _jit_sym_frommatrix, in_mat, NULL);
+		jit_object_method(overlay_mat, _jit_sym_getdata, &bp);
+		
+		return jit_cv::wrap(bp, info);
+	}
+	
 	void jit_matrix(t_symbol * name) {
 		t_jit_matrix_info in_info;
 		char * in_bp;
@@ -111,45 +481,55 @@ public:
 			return;
 		}
 		
-		// create CV mat wrapper around Jitter matrix data
-		// (cv declares dim as numrows, numcols)
-		cv::Mat InImage(in_info.dim[1], in_info.dim[0], CV_8UC(in_info.planecount), in_bp, in_info.dimstride[1]);
+		if (async) {
+			// copy the frame out & let go of the matrix straight away:
+			submit(in_bp, in_info);
+			jit_object_method(in_mat, _jit_sym_lock, in_savelock);
+			
+			// pass the image through:
+			atom_setsym(a, name);
+			outlet_anything(outlet_img, _jit_sym_jit_matrix, 1, a);
+			
+			// output the latest complete result, if there is a new one:
+			if (take_result()) {
+				atom_setlong(a, Markers.size());
+				outlet_anything(outlet_msg, _sym_count, 1, a);
+				output_markers();
+			}
+			return;
+		}
 
-		cv::Mat grey;
-		if ( InImage.type()==CV_8UC1) grey=InImage;
-		else cv::cvtColor(InImage,grey,CV_RGBA2GRAY);
+		// grey view of the input (wraps single-plane matrices, so keep it locked):
+		cv::Mat grey = jit_cv::luma(in_bp, in_info, Grey);
 		
 		try {
 		
 			bool setYPerpendicular = false;
 		
-			aruco::CameraParameters CParams(cvIntrinsic, cvDistortion, cv::Size(in_info.dim[0], in_info.dim[1]));
+			update_params(cv::Size(in_info.dim[0], in_info.dim[1]));
 		
 			if (use_calibration) {				
 				MDetector.detect(grey, Markers, CParams, markersize, setYPerpendicular);
-				
-				//for each marker, draw info and its boundaries in the image
-				for (unsigned int i=0;i<Markers.size();i++) {
-				
-					aruco::Marker& m = Markers[i];
-				
-					m.draw(InImage,cv::Scalar(0,0,255),2);
-					aruco::CvDrawingUtils::draw3dCube(InImage, m, CParams, setYPerpendicular);
-					
-				}
-				
+				aruco_reprojection_errors(Markers, CParams, Errors);
 			} else {
 				MDetector.detect(grey, Markers);
+				Errors.assign(Markers.size(), 0.f);
+			}
+			
+			if (Recorder.isOpen()) record_frame(grey);
+			
+			if (overlay) {
+				cv::Mat OutImage = copy_to_overlay(in_mat, in_info);
 				
 				//for each marker, draw info and its boundaries in the image
 				for (unsigned int i=0;i<Markers.size();i++) {
 				
 					aruco::Marker& m = Markers[i];
 				
-					m.draw(InImage,cv::Scalar(0,0,255),2);
+					m.draw(OutImage,cv::Scalar(0,0,255),2);
+					if (use_calibration) aruco::CvDrawingUtils::draw3dCube(OutImage, m, CParams, setYPerpendicular);
 					
 				}
-				
 			}
 			
 		} catch (std::exception &ex) {
@@ -163,12 +543,16 @@ public:
 		atom_setlong(a, Markers.size());
 		outlet_anything(outlet_msg, _sym_count, 1, a);
 			
-		// output the image:
-		atom_setsym(a, name);
-		outlet_anything(outlet_img, _jit_sym_jit_matrix, 1, a);
+		// output the image, annotated or untouched:
+		if (overlay) {
+			outlet_anything(outlet_img, _jit_sym_jit_matrix, 1, overlay_mat_name);
+		} else {
+			atom_setsym(a, name);
+			outlet_anything(outlet_img, _jit_sym_jit_matrix, 1, a);
+		}
 		
 		// now output the markers:
-		bang();
+		output_markers();
 	}
 };
 
@@ -182,17 +566,13 @@ void aruco_assist(t_aruco *x, void *b, long m, long a, char *s)
 		}
 	} else {	// outlet
 		if (a == 0) {
-			sprintf(s, "HMD orientation quaternion (list)"); 
+			sprintf(s, "index, id, position of each marker (list)"); 
 		} else if (a == 1) {
-			sprintf(s, "modified image (jit_matrix)"); 
+			sprintf(s, "image, annotated if @overlay is on (jit_matrix)"); 
 		} else if (a == 2) {
-			sprintf(s, "HMD left eye mesh (jit_matrix)"); 
+			sprintf(s, "marker count (messages)"); 
 		} else if (a == 3) {
-			sprintf(s, "HMD right eye properties (messages)"); 
-		} else if (a == 4) {
-			sprintf(s, "HMD right eye mesh (jit_matrix)");  
-		} else if (a == 5) {
-			sprintf(s, "HMD properties (messages)");
+			sprintf(s, "id, corners, position, quaternion, error of all markers (jit_matrix)"); 
 		} else {
 			sprintf(s, "I am outlet %ld", a); 
 		}
@@ -212,6 +592,7 @@ void *aruco_new(t_symbol *s, long argc, t_atom *argv)
 	t_aruco *x = NULL;
 	if (x = (t_aruco *)object_alloc(aruco_class)) {
 		
+		x->outlet_markers = outlet_new(x, "jit_matrix");
 		x->outlet_msg = outlet_new(x, 0);
 		x->outlet_img = outlet_new(x, "jit_matrix");
 		x->outlet_c = listout(x);
@@ -241,10 +622,33 @@ void aruco_jit_matrix(t_aruco * x, t_symbol *s) {
 	x->jit_matrix(s);
 }
 
+t_max_err aruco_camera_intrinsic_set(t_aruco *x, void *attr, long argc, t_atom *argv) {
+	for (long i=0; i<argc && i<9; i++) x->camera_intrinsic[i] = atom_getfloat(argv+i);
+	x->params_dirty = 1;
+	return 0;
+}
+
+t_max_err aruco_camera_distortion_set(t_aruco *x, void *attr, long argc, t_atom *argv) {
+	for (long i=0; i<argc && i<5; i++) x->camera_distortion[i] = atom_getfloat(argv+i);
+	x->params_dirty = 1;
+	return 0;
+}
+
+t_max_err aruco_record_set(t_aruco *x, void *attr, long argc, t_atom *argv) {
+	x->set_record(argc ? atom_getsym(argv) : gensym(""));
+	return 0;
+}
+
 void aruco_bang(t_aruco * x) {
 	x->bang();
 }
 
+void *aruco_worker(t_aruco *x) {
+	x->work();
+	systhread_exit(0);
+	return NULL;
+}
+
 int C74_EXPORT main(void) {	
 	t_class *maxclass;
 	common_symbols_init();
@@ -261,12 +665,32 @@ int C74_EXPORT main(void) {
 	CLASS_ATTR_FLOAT(maxclass, "markersize", 0, t_aruco, markersize);
 	
 	CLASS_ATTR_FLOAT_ARRAY(maxclass, "camera_distortion", 0, t_aruco, camera_distortion, 5);
+	CLASS_ATTR_ACCESSORS(maxclass, "camera_distortion", NULL, aruco_camera_distortion_set);
 
 	CLASS_ATTR_FLOAT_ARRAY(maxclass, "camera_intrinsic", 0, t_aruco, camera_intrinsic, 9);
+	CLASS_ATTR_ACCESSORS(maxclass, "camera_intrinsic", NULL, aruco_camera_intrinsic_set);
 	
 	CLASS_ATTR_LONG(maxclass, "use_calibration", 0, t_aruco, use_calibration);
 	CLASS_ATTR_STYLE(maxclass, "use_calibration", 0, "onoff");
 	
+	// detect on a worker thread; frames that arrive while it is busy are dropped,
+	// and the latest result is output with the next frame or bang (no drawing):
+	CLASS_ATTR_LONG(maxclass, "async", 0, t_aruco, async);
+	CLASS_ATTR_STYLE(maxclass, "async", 0, "onoff");
+	
+	// draw the markers into a copy of the input, and output that instead:
+	CLASS_ATTR_LONG(maxclass, "overlay", 0, t_aruco, overlay);
+	CLASS_ATTR_STYLE(maxclass, "overlay", 0, "onoff");
+	
+	// per-marker lists, as well as the markers matrix:
+	CLASS_ATTR_LONG(maxclass, "lists", 0, t_aruco, lists);
+	CLASS_ATTR_STYLE(maxclass, "lists", 0, "onoff");
+	
+	// write each frame, the camera model and the markers found to a frame log
+	// (a file path; not while @async is on):
+	CLASS_ATTR_SYM(maxclass, "record", 0, t_aruco, record);
+	CLASS_ATTR_ACCESSORS(maxclass, "record", NULL, aruco_record_set);
+	
 	
 	class_register(CLASS_BOX, maxclass); 
 	aruco_class = maxclass;
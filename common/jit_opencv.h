@@ -0,0 +1,132 @@
+/*
+	Jitter <-> OpenCV adapter, shared by the OpenCV externals.
+
+	Header-only; include after jit.common.h and the OpenCV headers, with a
+	relative path ("../common/jit_opencv.h").
+
+	Jitter char matrices are ARGB: plane 0 is alpha, planes 1-3 are R, G, B.
+	OpenCV's CV_RGBA2GRAY assumes the alpha is last, so it weights the wrong
+	planes; use luma() / luma_into() here instead.
+*/
+#ifndef JIT_OPENCV_H
+#define JIT_OPENCV_H
+
+#include <opencv2/core/core.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define JIT_OPENCV_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+namespace jit_cv {
+
+// accessors over a matrix info (t_jit_matrix_info or anything shaped like it):
+
+template<typename Info>
+inline long width(const Info& info) { return info.dim[0]; }
+
+template<typename Info>
+inline long height(const Info& info) { return info.dimcount > 1 ? info.dim[1] : 1; }
+
+template<typename Info>
+inline long planes(const Info& info) { return info.planecount; }
+
+template<typename T, typename Info>
+inline T * row(char * bp, const Info& info, long y) {
+	return (T *)(bp + y*info.dimstride[1]);
+}
+
+// a cell as a struct; goes by dimstride, so matrices with extra planes are fine:
+template<typename T, typename Info>
+inline T * cell(char * bp, const Info& info, long x, long y) {
+	return (T *)(bp + y*info.dimstride[1] + x*info.dimstride[0]);
+}
+
+// wrap a 2D char matrix as a cv::Mat header, without copying
+// (cv declares dim as numrows, numcols):
+template<typename Info>
+inline cv::Mat wrap(char * bp, const Info& info) {
+	return cv::Mat(height(info), width(info), CV_8UC(planes(info)), bp, info.dimstride[1]);
+}
+
+enum {
+	LUMA_AUTO = -1		// 1 plane: as is; 3 planes: RGB; 4 planes: ARGB; otherwise plane 0
+};
+
+// luma of n ARGB pixels, weights (77 R + 150 G + 29 B) >> 8:
+inline void luma_argb_row(const unsigned char * src, unsigned char * dst, long n) {
+	long i = 0;
+#ifdef JIT_OPENCV_SSE2
+	// 16 pixels at a time; in each 32-bit lane the bytes are A R G B
+	const __m128i lo = _mm_set1_epi32(0x00ff00ff);
+	const __m128i w_rb = _mm_set1_epi32((29 << 16) | 77);
+	const __m128i w_ag = _mm_set1_epi32(150 << 16);
+	for (; i + 16 <= n; i += 16, src += 64, dst += 16) {
+		__m128i y[4];
+		for (int k=0; k<4; k++) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + 16*k));
+			__m128i rb = _mm_srli_epi16(v, 8);		// R, B in 16-bit lanes
+			__m128i ag = _mm_and_si128(v, lo);		// A, G in 16-bit lanes
+			y[k] = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(rb, w_rb), _mm_madd_epi16(ag, w_ag)), 8);
+		}
+		__m128i y01 = _mm_packs_epi32(y[0], y[1]);
+		__m128i y23 = _mm_packs_epi32(y[2], y[3]);
+		_mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(y01, y23));
+	}
+#endif
+	for (; i < n; i++, src += 4, dst++) {
+		*dst = (unsigned char)((77*src[1] + 150*src[2] + 29*src[3]) >> 8);
+	}
+}
+
+// luma of n packed RGB pixels:
+inline void luma_rgb_row(const unsigned char * src, unsigned char * dst, long n) {
+	for (long i = 0; i < n; i++, src += 3, dst++) {
+		*dst = (unsigned char)((77*src[0] + 150*src[1] + 29*src[2]) >> 8);
+	}
+}
+
+// one plane of a row:
+inline void plane_row(const unsigned char * src, long stride, unsigned char * dst, long n) {
+	for (long i = 0; i < n; i++, src += stride, dst++) {
+		*dst = *src;
+	}
+}
+
+// write the grey image of a char matrix into dst, which is reallocated only
+// when the size changes; plane >= 0 selects a single plane instead:
+template<typename Info>
+inline void luma_into(char * bp, const Info& info, cv::Mat& dst, int plane = LUMA_AUTO) {
+	long w = width(info), h = height(info), pc = planes(info);
+
+	dst.create(h, w, CV_8UC1);
+	if (plane >= pc) plane = pc - 1;
+
+	for (long y = 0; y < h; y++) {
+		const unsigned char * src = row<unsigned char>(bp, info, y);
+		unsigned char * out = dst.ptr<unsigned char>(y);
+
+		if (plane >= 0) {
+			plane_row(src + plane, info.dimstride[0], out, w);
+		} else if (pc == 4 && info.dimstride[0] == 4) {
+			luma_argb_row(src, out, w);
+		} else if (pc == 3 && info.dimstride[0] == 3) {
+			luma_rgb_row(src, out, w);
+		} else {
+			plane_row(src, info.dimstride[0], out, w);
+		}
+	}
+}
+
+// as luma_into, but a single-plane matrix is wrapped rather than copied, so the
+// result may point into the matrix and is only valid while it stays locked:
+template<typename Info>
+inline cv::Mat luma(char * bp, const Info& info, cv::Mat& buffer, int plane = LUMA_AUTO) {
+	if (planes(info) == 1) return wrap(bp, info);
+	luma_into(bp, info, buffer, plane);
+	return buffer;
+}
+
+} // namespace jit_cv
+
+#endif // JIT_OPENCV_H
@@ -21,12 +21,57 @@ extern "C" {
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/calib3d/calib3d.hpp"
 
+#include "../common/jit_opencv.h"
+
 #include <new>
 #include <vector>
+#include <string>
+#include <bitset>
+#include <algorithm>
+#include <cfloat>
 
 struct vec2f { float x, y; };
 struct vec3f { float x, y, z; };
 
+// a snapshot of the accumulated points, which can be solved away from the Max threads:
+struct t_calibration_job {
+	long epoch;		// see t_calibratecamera::epoch
+	
+	// inputs, one entry per view:
+	std::vector<long> ids;
+	std::vector<std::vector<cv::Point3f> > objectPoints;
+	std::vector<std::vector<cv::Point2f> > imagePoints;
+	cv::Size imageSize;
+	int flags;
+	int merge_points;
+	double outlier_threshold;
+	
+	// outputs (intrinsic & distortion also hold the initial guess):
+	cv::Mat intrinsic, distortion;
+	std::vector<cv::Mat> rvecs, tvecs;	// as returned by calibrateCamera
+	double reprojection_error;
+	std::string error;
+	
+	// per view outputs (with incremental & merge_points, view_rvecs & view_tvecs also hold
+	// the previous extrinsics, as solvePnP's initial guess; calibrateCamera takes none):
+	std::vector<cv::Mat> view_rvecs, view_tvecs;
+	std::vector<float> view_errors;		// RMS reprojection error in pixels
+	std::vector<char> dropped;			// rejected as outliers
+};
+
+// summary of one view (image points matrix), used to choose which views to keep:
+struct t_view_info {
+	std::bitset<64> coverage;	// cells of an 8x8 grid over the image touched by the points
+	cv::Point2f tilt;			// log ratios of opposite edges of the board (0,0 when fronto-parallel)
+	
+	long id;					// stable across view removals
+	cv::Mat rvec, tvec;			// extrinsics from the last solve that included this view
+};
+
+class t_calibratecamera;
+void calibratecamera_deliver(t_calibratecamera *x);
+void *calibratecamera_worker(t_calibratecamera *x);
+
 class t_calibratecamera {
 public:
 	t_object ob;
@@ -51,6 +96,11 @@ public:
 	int merge_points;
 	int rodrigues;
 	int invert_extrinsics;
+	int async;
+	int max_views;
+	float min_view_distance;
+	int incremental;
+	float outlier_threshold;
 	double reprojection_error;
 	double distortion[5];
 	double intrinsic[9];
@@ -62,6 +112,16 @@ public:
 	std::vector<std::vector<cv::Point3f> > objectPoints;
 	// the positions of the detected chessboard points in the camera view:
 	std::vector<std::vector<cv::Point2f> > imagePoints;
+	// per view summaries, parallel to imagePoints:
+	std::vector<t_view_info> views;
+	long next_view_id;
+	// whether cvIntrinsic & cvDistortion hold a solution:
+	int has_solution;
+	
+	// per view reprojection errors:
+	void *		errors_mat;
+	void *		errors_mat_wrapper;
+	t_symbol *	errors_mat_name;
 	// the intrinsic matrix (focal length, center of projection)
 	cv::Mat cvIntrinsic;
 	// the distortion coefficients (radial, tangential)
@@ -69,6 +129,15 @@ public:
 	// the estimated rotation & translation of each object/image pair
 	std::vector<cv::Mat> rvecs, tvecs;
 	
+	// async solving:
+	t_systhread worker;
+	t_systhread_mutex worker_mutex;
+	void * worker_qelem;
+	int worker_running, worker_quit;
+	long epoch;						// bumped by clear(): results of older jobs no longer apply
+	t_calibration_job * pending;	// waiting for the worker
+	t_calibration_job * result;		// solved, waiting to be output
+	
 	t_calibratecamera() {
 		image_size[0] = 640;
 		image_size[1] = 480;
@@ -76,6 +145,31 @@ public:
 		merge_points = 1;
 		rodrigues = 0;
 		invert_extrinsics = 0;
+		async = 0;
+		
+		// view selection:
+		max_views = 0;
+		min_view_distance = 0.f;
+		next_view_id = 0;
+		
+		// incremental recalibration:
+		incremental = 0;
+		outlier_threshold = 0.f;
+		has_solution = 0;
+		
+		// create the per view error matrix:
+		t_jit_matrix_info info;
+		errors_mat_wrapper = jit_object_new(gensym("jit_matrix_wrapper"), jit_symbol_unique(), 0, NULL);
+		errors_mat = jit_object_method(errors_mat_wrapper, _jit_sym_getmatrix);
+		jit_matrix_info_default(&info);
+		info.flags |= JIT_MATRIX_DATA_PACK_TIGHT;
+		info.planecount = 1;
+		info.type = _jit_sym_float32;
+		info.dimcount = 1;
+		info.dim[0] = 1;
+		jit_object_method(errors_mat, _jit_sym_setinfo_ex, &info);
+		jit_object_method(errors_mat, _jit_sym_clear);
+		errors_mat_name = jit_attr_getsym(errors_mat_wrapper, _jit_sym_name);
 		
 		// intrinsic options:
 		calibrate_aspect_ratio = 1;
@@ -97,12 +191,39 @@ public:
 		// add a proxy inlet:
 		proxy = proxy_new(this, 1, &proxy_inlet_num);
 		
+		worker = 0;
+		worker_running = 0;
+		worker_quit = 0;
+		epoch = 0;
+		pending = 0;
+		result = 0;
+		systhread_mutex_new(&worker_mutex, 0);
+		worker_qelem = qelem_new(this, (method)calibratecamera_deliver);
+		
 		// initialize:
 		clear();
 	}
 	
 	~t_calibratecamera() {
+		unsigned int ret;
 		
+		systhread_mutex_lock(worker_mutex);
+		worker_quit = 1;
+		if (pending) delete pending;
+		pending = 0;
+		systhread_mutex_unlock(worker_mutex);
+		
+		// a solve in progress cannot be interrupted; wait for it:
+		if (worker) systhread_join(worker, &ret);
+		
+		qelem_free(worker_qelem);
+		if (result) delete result;
+		systhread_mutex_free(worker_mutex);
+		
+		if (errors_mat_wrapper) {
+			object_free(errors_mat_wrapper);
+			errors_mat_wrapper = NULL;
+		}
 	}
 	
 	void clear() {
@@ -112,37 +233,57 @@ public:
 		
 		objectPoints.clear();
 		imagePoints.clear();
+		views.clear();
 		rvecs.clear();
 		tvecs.clear();
 		
 		images = 0;
+		has_solution = 0;
+		
+		// results of solves already in flight no longer apply:
+		systhread_mutex_lock(worker_mutex);
+		epoch++;
+		if (pending) delete pending;
+		if (result) delete result;
+		pending = 0;
+		result = 0;
+		systhread_mutex_unlock(worker_mutex);
 	}
 	
 	void bang() {
-		t_atom a[9];
+		t_calibration_job * job = new t_calibration_job;
+		if (!prepare(*job)) {
+			delete job;
+		} else if (async) {
+			submit(job);
+		} else {
+			solve(*job);
+			finish(job);
+		}
+	}
+	
+	// validate and snapshot the current points:
+	bool prepare(t_calibration_job& job) {
 		unsigned int num_images = imagePoints.size();
 		
 		// verify the data exists and has matching length: 
 		if (objectPoints.size() < 1) {
 			object_error(&ob, "no object points received");
-			return;
+			return false;
 		} else if (num_images < 1) {
 			object_error(&ob, "no image points received");
-			return;
+			return false;
 		} 
-		if (objectPoints.size() == 1) {
-			// resize to match:
-			objectPoints.resize(num_images, objectPoints[0]);
-		} else if (objectPoints.size() != num_images) {
+		if (objectPoints.size() != 1 && objectPoints.size() != num_images) {
 			object_error(&ob, "cannot calibrate; number of image matrices does not match number of object matrices");
-			return;
+			return false;
 		}
 		// verify the sizes match:
-		for (unsigned int i=0; i<objectPoints.size(); i++) {
+		for (unsigned int i=0; i<num_images; i++) {
 			//post("%d size %d", i, objectPoints[i].size());
-			if (objectPoints[i].size() != imagePoints[i].size()) {
+			if (objects(i).size() != imagePoints[i].size()) {
 				object_error(&ob, "cannot calibrate; the dimensions of the image and object matrices do not match");
-				return;
+				return false;
 			}
 		}
 		
@@ -154,68 +295,263 @@ public:
 		if (!calibrate_aspect_ratio) flags |= CV_CALIB_FIX_ASPECT_RATIO;
 		if (!calibrate_principal_point) flags |= CV_CALIB_FIX_PRINCIPAL_POINT;
 		if (!calibrate_tangent_distortion) flags |= CV_CALIB_ZERO_TANGENT_DIST;
-				
-		cv::Size imageSize(image_size[0], image_size[1]);
-		
-		// initialize estimate intrinsics:
-		cvIntrinsic = 0.;	// zero it
-		cvIntrinsic.at<double>(0,0) = image_size[1];	// fx
-		cvIntrinsic.at<double>(1,1) = image_size[1];	// fy
-		cvIntrinsic.at<double>(0,2) = image_size[0]/2.;	// cx
-		cvIntrinsic.at<double>(1,2) = image_size[1]/2.;	// cy
-		cvIntrinsic.at<double>(2,2) = 1;
 		
-		// initialize with zero distortion:
-		cvDistortion = 0.;
+		job.flags = flags;
+		job.imageSize = cv::Size(image_size[0], image_size[1]);
+		job.merge_points = merge_points;
+		job.outlier_threshold = outlier_threshold;
 		
-		
-		rvecs.clear();
-		tvecs.clear();
+		if (incremental && has_solution) {
+			// start from the previous solution:
+			job.intrinsic = cvIntrinsic.clone();
+			job.distortion = cvDistortion.clone();
+		} else {
+			// initialize estimate intrinsics:
+			job.intrinsic = cv::Mat::zeros(3, 3, CV_64F);
+			job.intrinsic.at<double>(0,0) = image_size[1];	// fx
+			job.intrinsic.at<double>(1,1) = image_size[1];	// fy
+			job.intrinsic.at<double>(0,2) = image_size[0]/2.;	// cx
+			job.intrinsic.at<double>(1,2) = image_size[1]/2.;	// cy
+			job.intrinsic.at<double>(2,2) = 1;
+			
+			// initialize with zero distortion:
+			job.distortion = cv::Mat::zeros(5, 1, CV_64F);
+		}
 		
 		//object_post(&ob, "calibrate from %d images / objects", imagePoints.size(), objectPoints.size());
 		
-		// Some implementations appear to prefer putting all points into one list:
-		std::vector<std::vector<cv::Point3f> > vvo(1); //object points
-		std::vector<std::vector<cv::Point2f> > vvi(1); //image points
-		if (merge_points) {
-			for (int i=0; i<objectPoints.size(); ++i) {
-				for (int j = 0; j<objectPoints[i].size(); j++) {
-					vvo[0].push_back(objectPoints[i][j]);
-					vvi[0].push_back(imagePoints[i][j]);
-					
-					// verify:
-					//post("%d,%d: object %f %f %f image %f %f", i, j, objectPoints[i][j].x, objectPoints[i][j].y, objectPoints[i][j].z, imagePoints[i][j].x, imagePoints[i][j].y);
-				}
-			}
+		// snapshot every view (a single object matrix applies to all of them); previous
+		// poses are only read back by the merge_points path of solve():
+		bool seed_poses = incremental && merge_points;
+		for (unsigned int i=0; i<num_images; ++i) {
+			job.ids.push_back(views[i].id);
+			job.objectPoints.push_back(objects(i));
+			job.view_rvecs.push_back(seed_poses ? views[i].rvec.clone() : cv::Mat());
+			job.view_tvecs.push_back(seed_poses ? views[i].tvec.clone() : cv::Mat());
 		}
+		job.imagePoints = imagePoints;
+		return true;
+	}
+	
+	// the object points of view i:
+	const std::vector<cv::Point3f>& objects(unsigned int i) const {
+		return objectPoints.size() == 1 ? objectPoints[0] : objectPoints[i];
+	}
+	
+	// run the solver; touches nothing but the job, so it may run on any thread:
+	static void solve(t_calibration_job& job) {
+		unsigned int num_views = job.imagePoints.size();
+		job.view_rvecs.resize(num_views);
+		job.view_tvecs.resize(num_views);
+		job.view_errors.assign(num_views, 0.f);
+		job.dropped.assign(num_views, 0);
 		
 		try {
-			if (merge_points) {
-				reprojection_error = calibrateCamera(
-					vvo, vvi, 
-					imageSize, 
-					cvIntrinsic, cvDistortion, rvecs, tvecs, 
-					flags
-				);
-			} else {
-				reprojection_error = calibrateCamera(
-					objectPoints, imagePoints,
-					imageSize, 
-					cvIntrinsic, cvDistortion, rvecs, tvecs, 
-					flags
+			// solve, then drop outlier views & re-solve from the new estimate (a few times at most):
+			for (int round = 0; round < 3; round++) {
+				std::vector<std::vector<cv::Point3f> > vvo; //object points
+				std::vector<std::vector<cv::Point2f> > vvi; //image points
+				std::vector<unsigned int> used;
+				
+				// Some implementations appear to prefer putting all points into one list:
+				if (job.merge_points) {
+					vvo.resize(1);
+					vvi.resize(1);
+				}
+				for (unsigned int i=0; i<num_views; i++) {
+					if (job.dropped[i]) continue;
+					used.push_back(i);
+					if (job.merge_points) {
+						vvo[0].insert(vvo[0].end(), job.objectPoints[i].begin(), job.objectPoints[i].end());
+						vvi[0].insert(vvi[0].end(), job.imagePoints[i].begin(), job.imagePoints[i].end());
+					} else {
+						vvo.push_back(job.objectPoints[i]);
+						vvi.push_back(job.imagePoints[i]);
+					}
+				}
+				
+				job.reprojection_error = calibrateCamera(
+					vvo, vvi,
+					job.imageSize, 
+					job.intrinsic, job.distortion, job.rvecs, job.tvecs, 
+					job.flags
 				);
+				
+				unsigned int outliers = 0;
+				for (unsigned int k=0; k<used.size(); k++) {
+					unsigned int i = used[k];
+					cv::Mat& rvec = job.view_rvecs[i];
+					cv::Mat& tvec = job.view_tvecs[i];
+					if (job.merge_points) {
+						// merged views share one pose; recover each view's own, from the previous one if known:
+						bool guess = !rvec.empty() && !tvec.empty();
+						cv::solvePnP(job.objectPoints[i], job.imagePoints[i], job.intrinsic, job.distortion, rvec, tvec, guess);
+					} else {
+						job.rvecs[k].copyTo(rvec);
+						job.tvecs[k].copyTo(tvec);
+					}
+					
+					std::vector<cv::Point2f> projected;
+					cv::projectPoints(job.objectPoints[i], rvec, tvec, job.intrinsic, job.distortion, projected);
+					double sum = 0.;
+					for (unsigned int j=0; j<projected.size(); j++) {
+						cv::Point2f d = projected[j] - job.imagePoints[i][j];
+						sum += d.dot(d);
+					}
+					job.view_errors[i] = projected.empty() ? 0.f : sqrt(sum / projected.size());
+					if (job.outlier_threshold > 0. && job.view_errors[i] > job.outlier_threshold) outliers++;
+				}
+				
+				// keep at least two views, and only drop any if another solve follows, so that
+				// the results always come from exactly the views that are kept:
+				if (round == 2 || outliers == 0 || used.size() - outliers < 2) break;
+				for (unsigned int k=0; k<used.size(); k++) {
+					if (job.view_errors[used[k]] > job.outlier_threshold) job.dropped[used[k]] = 1;
+				}
 			}
 		}
 		catch (cv::Exception& ex) {
-			object_error(&ob, ex.what());
+			job.error = ex.what();
+		}
+		catch (std::exception& ex) {
+			// e.g. std::bad_alloc with many views; must not escape the worker thread
+			job.error = ex.what();
+		}
+	}
+	
+	// adopt a solved job's results & output them (consumes the job):
+	void finish(t_calibration_job * job) {
+		if (!job->error.empty()) {
+			object_error(&ob, "%s", job->error.c_str());
+			delete job;
 			return;
 		}
 		
-		for (unsigned int i=0; i<tvecs.size(); i++) {
-			// let's look at rvecs & tvecs:
-			//post("tvec %d %f %f %f", i, tvecs[i].at<double>(0), tvecs[i].at<double>(1), tvecs[i].at<double>(2));
-			//post("rvec %d %f %f %f", i, rvecs[i].at<double>(0), rvecs[i].at<double>(1), rvecs[i].at<double>(2));
+		// copy into the attribute arrays that cvIntrinsic & cvDistortion wrap:
+		job->intrinsic.copyTo(cvIntrinsic);
+		job->distortion.copyTo(cvDistortion);
+		rvecs = job->rvecs;
+		tvecs = job->tvecs;
+		reprojection_error = job->reprojection_error;
+		has_solution = 1;
+		
+		// remember each view's pose & forget outliers (views may have changed since the job was made):
+		for (unsigned int i=0; i<job->ids.size(); i++) {
+			for (unsigned int v=0; v<views.size(); v++) {
+				if (views[v].id != job->ids[i]) continue;
+				if (job->dropped[i]) {
+					imagePoints.erase(imagePoints.begin() + v);
+					views.erase(views.begin() + v);
+					if (objectPoints.size() > 1) objectPoints.erase(objectPoints.begin() + v);
+				} else {
+					views[v].rvec = job->view_rvecs[i];
+					views[v].tvec = job->view_tvecs[i];
+				}
+				break;
+			}
 		}
+		images = imagePoints.size();
+		
+		output_view_errors(*job);
+		delete job;
+		
+		output();
+	}
+	
+	// per view RMS reprojection errors as a float32 matrix (outliers included, then dropped):
+	void output_view_errors(const t_calibration_job& job) {
+		t_jit_matrix_info info;
+		t_atom a[2];
+		float * data = NULL;
+		unsigned int dropped = 0;
+		
+		if (job.view_errors.empty()) return;
+		
+		jit_object_method(errors_mat, _jit_sym_getinfo, &info);
+		if (info.dim[0] != (long)job.view_errors.size()) {
+			info.dim[0] = job.view_errors.size();
+			jit_object_method(errors_mat, _jit_sym_setinfo_ex, &info);
+		}
+		jit_object_method(errors_mat, _jit_sym_getdata, &data);
+		if (data) std::copy(job.view_errors.begin(), job.view_errors.end(), data);
+		
+		for (unsigned int i=0; i<job.dropped.size(); i++) dropped += job.dropped[i];
+		atom_setlong(a, dropped);
+		outlet_anything(outlet_msg, gensym("dropped_views"), 1, a);
+		
+		atom_setsym(a, _jit_sym_jit_matrix);
+		atom_setsym(a+1, errors_mat_name);
+		outlet_anything(outlet_msg, gensym("view_errors"), 2, a);
+	}
+	
+	// hand a job to the worker thread, superseding any job it has not yet started
+	// (a solve in progress still completes & is output):
+	void submit(t_calibration_job * job) {
+		unsigned int ret;
+		
+		systhread_mutex_lock(worker_mutex);
+		job->epoch = epoch;
+		if (pending) delete pending;
+		pending = job;
+		bool start = !worker_running;
+		if (start) worker_running = 1;
+		systhread_mutex_unlock(worker_mutex);
+		
+		if (start) {
+			// reap the previous worker, which has run out of jobs:
+			if (worker) systhread_join(worker, &ret);
+			worker = 0;
+			systhread_create((method)calibratecamera_worker, this, 0, 0, 0, &worker);
+		}
+	}
+	
+	// worker thread: solve pending jobs until there are none left
+	void work() {
+		while (1) {
+			systhread_mutex_lock(worker_mutex);
+			t_calibration_job * job = pending;
+			pending = 0;
+			if (!job || worker_quit) {
+				worker_running = 0;
+				systhread_mutex_unlock(worker_mutex);
+				if (job) delete job;
+				return;
+			}
+			systhread_mutex_unlock(worker_mutex);
+			
+			solve(*job);
+			
+			// publish it as the newest result, unless the points were cleared meanwhile
+			// (newer requests don't discard it, or a steady stream of bangs would
+			// never see any output):
+			systhread_mutex_lock(worker_mutex);
+			bool current = (job->epoch == epoch);
+			if (current) {
+				if (result) delete result;
+				result = job;
+			}
+			systhread_mutex_unlock(worker_mutex);
+			
+			if (current) {
+				qelem_set(worker_qelem);
+			} else {
+				delete job;
+			}
+		}
+	}
+	
+	// main thread (qelem): output the latest result
+	void deliver() {
+		systhread_mutex_lock(worker_mutex);
+		t_calibration_job * job = result;
+		result = 0;
+		systhread_mutex_unlock(worker_mutex);
+		
+		if (job) finish(job);
+	}
+	
+	void output() {
+		t_atom a[9];
 		
 		// output right to left:
 		
@@ -301,21 +637,136 @@ public:
 		}
 		
 		std::vector<cv::Point2f> pts;
-		for (int i=0, y=0; y<in_info.dim[1]; y++) {
-			char * row_bp = in_bp + y*in_info.dimstride[1];
-			for (int x=0; x<in_info.dim[0]; x++, i++) {
-				// done like this so that we can accomodate matrices with planecount > 2
-				vec2f * cell = (vec2f *)(row_bp + x*in_info.dimstride[0]);
+		for (int y=0; y<in_info.dim[1]; y++) {
+			for (int x=0; x<in_info.dim[0]; x++) {
+				// by dimstride, so that we can accomodate matrices with planecount > 2
+				vec2f * cell = jit_cv::cell<vec2f>(in_bp, in_info, x, y);
 				pts.push_back(cv::Point2f(cell->x, cell->y));
-				cell++;
 			}
 		}
-		imagePoints.push_back(pts);
-		
-		images = imagePoints.size();
 		
 		// restore matrix lock state:
 		jit_object_method(in_mat, _jit_sym_lock, in_savelock);
+		
+		add_view(pts, in_info.dim[0], in_info.dim[1]);
+		
+		images = imagePoints.size();
+	}
+	
+	t_view_info summarize_view(const std::vector<cv::Point2f>& pts, long cols, long rows) {
+		t_view_info info;
+		
+		float gx = 8.f/image_size[0], gy = 8.f/image_size[1];
+		for (unsigned int i=0; i<pts.size(); i++) {
+			int cx = std::min(std::max(int(pts[i].x * gx), 0), 7);
+			int cy = std::min(std::max(int(pts[i].y * gy), 0), 7);
+			info.coverage.set(cy*8 + cx);
+		}
+		
+		// perspective foreshortening from the four outer corners of the grid:
+		info.tilt = cv::Point2f(0.f, 0.f);
+		if (cols > 1 && rows > 1 && pts.size() == (size_t)(cols*rows)) {
+			const cv::Point2f& p00 = pts[0];
+			const cv::Point2f& p10 = pts[cols-1];
+			const cv::Point2f& p01 = pts[(rows-1)*cols];
+			const cv::Point2f& p11 = pts[rows*cols-1];
+			double top = cv::norm(p10-p00), bottom = cv::norm(p11-p01);
+			double left = cv::norm(p01-p00), right = cv::norm(p11-p10);
+			if (top > 0 && bottom > 0 && left > 0 && right > 0) {
+				info.tilt.x = log(top/bottom);
+				info.tilt.y = log(left/right);
+			}
+		}
+		return info;
+	}
+	
+	// mean distance between corresponding points of two views, in pixels:
+	double view_distance(const std::vector<cv::Point2f>& a, const std::vector<cv::Point2f>& b) {
+		if (a.size() != b.size() || a.empty()) return DBL_MAX;
+		double sum = 0.;
+		for (unsigned int i=0; i<a.size(); i++) sum += cv::norm(a[i]-b[i]);
+		return sum / a.size();
+	}
+	
+	// how much view i adds to the others (plus the candidate, if not excluded):
+	// image-plane coverage, tilt diversity and novelty, each roughly in 0..1
+	double view_score(unsigned int i, const std::vector<std::vector<cv::Point2f> >& pts, const std::vector<t_view_info>& infos) {
+		int counts[64] = { 0 };
+		double mintilt = 1., mindist = DBL_MAX;
+		double diagonal = sqrt(double(image_size[0])*image_size[0] + double(image_size[1])*image_size[1]);
+		
+		for (unsigned int j=0; j<pts.size(); j++) {
+			if (j == i) continue;
+			for (int b=0; b<64; b++) counts[b] += infos[j].coverage[b];
+			mintilt = std::min(mintilt, (double)cv::norm(infos[i].tilt - infos[j].tilt));
+			mindist = std::min(mindist, view_distance(pts[i], pts[j]));
+		}
+		
+		double coverage = 0.;
+		for (int b=0; b<64; b++) {
+			if (infos[i].coverage[b]) coverage += 1./(1 + counts[b]);
+		}
+		coverage /= 16.;	// a quarter of the image, uncovered so far, scores 1
+		double novelty = std::min(1., 4. * mindist / diagonal);
+		return coverage + mintilt + novelty;
+	}
+	
+	// add a view, unless it duplicates one we have or (with max_views) scores lower than all kept views:
+	void add_view(const std::vector<cv::Point2f>& pts, long cols, long rows) {
+		t_atom a[2];
+		t_view_info info = summarize_view(pts, cols, rows);
+		info.id = next_view_id++;
+		
+		// object points per view cannot be matched to image views that are dropped,
+		// so selection only applies with a single object points matrix:
+		if (objectPoints.size() > 1) {
+			imagePoints.push_back(pts);
+			views.push_back(info);
+			return;
+		}
+		
+		if (min_view_distance > 0.f) {
+			for (unsigned int i=0; i<imagePoints.size(); i++) {
+				if (view_distance(pts, imagePoints[i]) < min_view_distance) {
+					atom_setsym(a, gensym("duplicate"));
+					atom_setlong(a+1, i);
+					outlet_anything(outlet_msg, gensym("view"), 2, a);
+					return;
+				}
+			}
+		}
+		
+		imagePoints.push_back(pts);
+		views.push_back(info);
+		
+		if (max_views <= 0 || imagePoints.size() <= (size_t)max_views) {
+			atom_setsym(a, gensym("accepted"));
+			atom_setlong(a+1, imagePoints.size()-1);
+			outlet_anything(outlet_msg, gensym("view"), 2, a);
+			return;
+		}
+		
+		// over budget: drop the view that contributes least
+		unsigned int worst = 0;
+		double worst_score = DBL_MAX;
+		for (unsigned int i=0; i<imagePoints.size(); i++) {
+			double score = view_score(i, imagePoints, views);
+			if (score < worst_score) {
+				worst_score = score;
+				worst = i;
+			}
+		}
+		imagePoints.erase(imagePoints.begin() + worst);
+		views.erase(views.begin() + worst);
+		
+		if (worst == imagePoints.size()) {
+			atom_setsym(a, gensym("rejected"));
+			atom_setlong(a+1, worst);
+		} else {
+			atom_setsym(a, gensym("replaced"));
+			atom_setlong(a+1, worst);
+		}
+		outlet_anything(outlet_msg, gensym("view"), 2, a);
 	}
 	
 	void object_points(t_symbol * name, void * in_mat) {
@@ -346,13 +797,12 @@ public:
 		}
 		
 		std::vector<cv::Point3f> pts;
-		for (int i=0, y=0; y<in_info.dim[1]; y++) {
-			vec3f * cell = (vec3f *)(in_bp + y*in_info.dimstride[1]);
-			for (int x=0; x<in_info.dim[0]; x++, i++) {
+		for (int y=0; y<in_info.dim[1]; y++) {
+			for (int x=0; x<in_info.dim[0]; x++) {
 				// allow 2-plane matrices for planar rigs:
+				vec3f * cell = jit_cv::cell<vec3f>(in_bp, in_info, x, y);
 				float z = in_info.planecount == 3 ? cell->z : 0.;
 				pts.push_back(cv::Point3f(cell->x, cell->y, z));
-				cell++;
 			}
 		}
 		objectPoints.push_back(pts);
@@ -402,6 +852,16 @@ void calibratecamera_clear(t_calibratecamera *x) {
 	x->clear();
 }
 
+void calibratecamera_deliver(t_calibratecamera *x) {
+	x->deliver();
+}
+
+void *calibratecamera_worker(t_calibratecamera *x) {
+	x->work();
+	systhread_exit(0);
+	return NULL;
+}
+
 void calibratecamera_assist(t_calibratecamera *x, void *b, long m, long a, char *s) {
 	if (m == ASSIST_INLET) { // inlet
 		switch (a) {
@@ -499,6 +959,21 @@ int C74_EXPORT main(void)
 	CLASS_ATTR_LONG(c, "invert_extrinsics", 0, t_calibratecamera, invert_extrinsics);
 	CLASS_ATTR_STYLE(c, "invert_extrinsics", 0, "onoff");
 	
+	// bound the number of views kept for solving, keeping those that add most coverage & diversity (0 = no limit):
+	CLASS_ATTR_LONG(c, "max_views", 0, t_calibratecamera, max_views);
+	// reject views whose points lie within this many pixels (on average) of a kept view (0 = off):
+	CLASS_ATTR_FLOAT(c, "min_view_distance", 0, t_calibratecamera, min_view_distance);
+	
+	// seed each solve with the previous intrinsics, distortion & per view extrinsics:
+	CLASS_ATTR_LONG(c, "incremental", 0, t_calibratecamera, incremental);
+	CLASS_ATTR_STYLE(c, "incremental", 0, "onoff");
+	// drop views whose RMS reprojection error exceeds this many pixels, and re-solve (0 = off):
+	CLASS_ATTR_FLOAT(c, "outlier_threshold", 0, t_calibratecamera, outlier_threshold);
+	
+	// solve on a worker thread; results are output from the main thread when ready:
+	CLASS_ATTR_LONG(c, "async", 0, t_calibratecamera, async);
+	CLASS_ATTR_STYLE(c, "async", 0, "onoff");
+	
 	
 	class_register(CLASS_BOX, c); /* CLASS_NOBOX */
 	calibratecamera_class = c;
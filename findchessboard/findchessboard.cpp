@@ -1,6 +1,7 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/video/tracking.hpp>
 
 #ifdef __cplusplus 
 extern "C" {
@@ -13,8 +14,12 @@ extern "C" {
 }
 #endif
 
+#include "../common/jit_opencv.h"
+
 #include <new>
 #include <vector>
+#include <algorithm>
+#include <math.h>
 
 
 t_class * findchessboard_class;
@@ -35,6 +40,8 @@ public:
 	// attrs:
 	char		size[2];
 	int			fast_check, adaptive_thresh, normalize_image, filter_quads;
+	int			track;
+	float		search_scale;
 	
 	// corners matrix:
 	void *		corners_mat;
@@ -44,11 +51,25 @@ public:
 	
 	std::vector<cv::Point2f> corners;
 	
+	// grey conversion of multi-plane input:
+	cv::Mat grey;
+	
+	// tracking state: the last frame in which the board was found, and its corners
+	cv::Mat prev_grey;
+	std::vector<cv::Point2f> prev_corners;
+	bool tracking;
+	
+	// downscaled image for the search:
+	cv::Mat small_grey;
+	
 	t_findchessboard() {
 		fast_check = 1;
 		adaptive_thresh = 1;
 		normalize_image = 1;
 		filter_quads = 0;
+		track = 0;
+		tracking = false;
+		search_scale = 1.f;
 		
 		size[0] = 10;
 		size[1] = 7;
@@ -91,6 +112,108 @@ public:
 		jit_object_method(corners_mat, _jit_sym_setinfo_ex, &info);
 		jit_object_method(corners_mat, _jit_sym_clear);
 		jit_object_method(corners_mat, _jit_sym_getdata, &corners_data);
+		
+		tracking = false;
+	}
+	
+	// the number of inner corners the board has:
+	size_t num_corners() const {
+		return (size_t)(size[0]*size[1]);
+	}
+	
+	// follow the previous corners into this frame with optical flow, refine them locally,
+	// and accept them only if they still form the expected grid:
+	bool track_corners(const cv::Mat& src) {
+		std::vector<cv::Point2f> predicted;
+		std::vector<uchar> status;
+		std::vector<float> err;
+		
+		if (prev_grey.size() != src.size() || prev_corners.size() != num_corners()) return false;
+		
+		cv::calcOpticalFlowPyrLK(prev_grey, src, prev_corners, predicted, status, err, cv::Size(15, 15), 2);
+		for (unsigned int i=0; i<status.size(); i++) {
+			if (!status[i]) return false;
+			if (predicted[i].x < 0 || predicted[i].y < 0 || predicted[i].x >= src.cols || predicted[i].y >= src.rows) return false;
+		}
+		
+		cv::cornerSubPix(src, predicted, cv::Size(5, 5), cv::Size(-1, -1), cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 10, 0.1));
+		
+		if (!check_grid(predicted)) return false;
+		corners = predicted;
+		return true;
+	}
+	
+	// full search for the board, optionally on a downscaled copy of the image;
+	// leaves the corners refined at full resolution
+	bool search(const cv::Mat& src, int flags) {
+		cv::Size patternSize(size[0], size[1]);
+		
+		if (search_scale <= 0.f || search_scale >= 1.f) {
+			if (!cv::findChessboardCorners(src, patternSize, corners, flags)
+				|| corners.size() != num_corners()) return false;
+			
+			// refine:
+			cv::cornerSubPix(src, corners, cv::Size(11, 11), cv::Size(-1, -1), cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
+			return true;
+		}
+		
+		cv::resize(src, small_grey, cv::Size(), search_scale, search_scale, cv::INTER_AREA);
+		if (!cv::findChessboardCorners(small_grey, patternSize, corners, flags)
+			|| corners.size() != num_corners()) return false;
+		
+		// back to full resolution (pixel centres map to pixel centres):
+		float inv = 1.f / search_scale;
+		for (unsigned int i=0; i<corners.size(); i++) {
+			corners[i].x = (corners[i].x + 0.5f) * inv - 0.5f;
+			corners[i].y = (corners[i].y + 0.5f) * inv - 0.5f;
+		}
+		
+		// refine at full resolution, with a window that covers the mapping error
+		// but stays within a square:
+		double spacing = square_size(corners);
+		int half = std::min(11, std::max(2, int(spacing * 0.4)));
+		half = std::max(half, std::min(int(spacing * 0.5) - 1, int(ceil(inv)) + 1));
+		cv::cornerSubPix(src, corners, cv::Size(half, half), cv::Size(-1, -1), cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
+		return true;
+	}
+	
+	// mean distance between horizontally adjacent corners, in pixels:
+	double square_size(const std::vector<cv::Point2f>& pts) {
+		int cols = size[0], rows = size[1];
+		double spacing = 0.;
+		if (cols < 2) return 0.;
+		for (int y=0; y<rows; y++) {
+			for (int x=1; x<cols; x++) {
+				spacing += cv::norm(pts[y*cols+x] - pts[y*cols+x-1]);
+			}
+		}
+		return spacing / (rows*(cols-1));
+	}
+	
+	// topology check: the corners must be explained by a homography of the ideal grid,
+	// to within a fraction of the mean square size
+	bool check_grid(const std::vector<cv::Point2f>& pts) {
+		int cols = size[0], rows = size[1];
+		std::vector<cv::Point2f> ideal;
+		
+		for (int y=0; y<rows; y++) {
+			for (int x=0; x<cols; x++) {
+				ideal.push_back(cv::Point2f(x, y));
+			}
+		}
+		double spacing = square_size(pts);
+		if (spacing < 1.) return false;
+		
+		cv::Mat H = cv::findHomography(ideal, pts, 0);
+		if (H.empty()) return false;
+		
+		std::vector<cv::Point2f> fitted;
+		cv::perspectiveTransform(ideal, fitted, H);
+		double tolerance = 0.5 * spacing;
+		for (unsigned int i=0; i<pts.size(); i++) {
+			if (cv::norm(fitted[i] - pts[i]) > tolerance) return false;
+		}
+		return true;
 	}
 	
 	void bang() {
@@ -127,19 +250,10 @@ public:
 			return;
 		}
 		
-		// create CV mat wrapper around Jitter matrix data
-		// (cv declares dim as numrows, numcols)
-		cv::Mat InImage(in_info.dim[1], in_info.dim[0], CV_8UC(in_info.planecount), in_bp, in_info.dimstride[1]);
-		
-		cv::Mat src;
-		if (in_info.planecount != 1) {
-			cv::cvtColor(InImage,src,CV_RGBA2GRAY);
-		} else {
-			src = InImage;
-		}
+		// grey view of the input (wraps single-plane matrices, so keep it locked):
+		cv::Mat src = jit_cv::luma(in_bp, in_info, grey);
 		
 		// set up CV arguments:
-		cv::Size patternSize(size[0], size[1]);
 		// do a fast detection first, then refine with cornerSubPix:
 		int flags = 0; 
 		if (fast_check) flags |= CV_CALIB_CB_FAST_CHECK;
@@ -147,23 +261,33 @@ public:
 		if (normalize_image) flags |= CV_CALIB_CB_NORMALIZE_IMAGE;
 		if (filter_quads) flags |= CV_CALIB_CB_FILTER_QUADS;
 
-		// first pass:
-		bool found = cv::findChessboardCorners(src, patternSize, corners, flags);
-		
-		// restore matrix lock state:
-		jit_object_method(in_mat, _jit_sym_lock, in_savelock);
+		// try to follow the board from the previous frame first:
+		bool found = false;
+		if (track && tracking) {
+			found = track_corners(src);
+		}
 		
+		// otherwise do a full search:
 		if (!found) {
-			return;
+			found = search(src, flags);
 		}
 		
-		if (corners.size() != size[0]*size[1]) {
+		if (!found) {
+			tracking = false;
+			
+			// restore matrix lock state:
+			jit_object_method(in_mat, _jit_sym_lock, in_savelock);
 			return;
 		}
 		
+		if (track) {
+			src.copyTo(prev_grey);
+			prev_corners = corners;
+			tracking = true;
+		}
 		
-		// refine:
-		cv::cornerSubPix(src, corners, cv::Size(11, 11), cv::Size(-1, -1), cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
+		// restore matrix lock state:
+		jit_object_method(in_mat, _jit_sym_lock, in_savelock);
 		
 		// copy into jit matrix:
 		for (int i=0; i<corners.size(); i++) {
@@ -284,6 +408,14 @@ int C74_EXPORT main(void) {
 	CLASS_ATTR_LONG(maxclass, "filter_quads", 0, t_findchessboard, filter_quads);
 	CLASS_ATTR_STYLE(maxclass, "filter_quads", 0, "onoff");
 	
+	// search a downscaled image (e.g. 0.5), then refine the corners at full resolution:
+	CLASS_ATTR_FLOAT(maxclass, "search_scale", 0, t_findchessboard, search_scale);
+	CLASS_ATTR_FILTER_CLIP(maxclass, "search_scale", 0.1, 1.);
+	
+	// follow the corners of the previous frame, and only search the whole image when that fails:
+	CLASS_ATTR_LONG(maxclass, "track", 0, t_findchessboard, track);
+	CLASS_ATTR_STYLE(maxclass, "track", 0, "onoff");
+	
 	
 	class_register(CLASS_BOX, maxclass); 
 	findchessboard_class = maxclass;
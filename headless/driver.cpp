@@ -0,0 +1,428 @@
+/*
+	Headless driver: loads recorded frames, pushes them through one external's
+	jit_matrix (and optionally bang) entry points, and reports latency and heap
+	allocations per frame.
+
+	usage: <driver> [options] [@attr values ...] frame ...
+
+		-n <count>		play the frame list this many times (default 1)
+		-warmup <count>	untimed passes before that (default 1)
+		-bang			send bang after each frame
+		-bang-end		send bang after the last frame
+		-dsp <blocks>	also time the perform routine for this many 64-sample blocks
+		-path <dir>		add a search path (e.g. for Lua scripts)
+		-v				print every outlet message
+
+	frames are binary PGM (1 plane) or PPM (ARGB) images, or .pts text files
+	("cols rows" then one "x y [z]" line per cell, as float32); prefix a frame
+	with "<inlet>:" to send it to another inlet.
+*/
+
+#include "headless.h"
+
+#include <time.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// allocation counting, see the end of the file:
+static volatile int s_counting = 0;
+static volatile long s_allocs = 0;
+static volatile long s_alloc_bytes = 0;
+
+struct t_frame {
+	long inlet;
+	std::string path;
+	t_symbol * name;
+};
+
+struct t_stats {
+	std::vector<double> latency;	// microseconds
+	std::vector<long> allocs, bytes;
+	std::vector<long> outlet_messages;
+	bool verbose;
+};
+
+static double now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+static void print_atoms(long argc, t_atom * argv) {
+	for (long i=0; i<argc; i++) {
+		switch (argv[i].a_type) {
+			case A_LONG: printf(" %ld", (long)atom_getlong(argv+i)); break;
+			case A_FLOAT: printf(" %g", atom_getfloat(argv+i)); break;
+			case A_SYM: printf(" %s", atom_getsym(argv+i)->s_name); break;
+			default: printf(" <%p>", atom_getobj(argv+i)); break;
+		}
+	}
+}
+
+static void on_outlet(void * ctx, void * x, long outlet, t_symbol * s, long argc, t_atom * argv) {
+	t_stats * stats = (t_stats *)ctx;
+	if (outlet >= (long)stats->outlet_messages.size()) stats->outlet_messages.resize(outlet + 1, 0);
+	stats->outlet_messages[outlet]++;
+
+	if (stats->verbose) {
+		int counting = s_counting;
+		s_counting = 0;
+		printf("outlet %ld: %s", outlet, s->s_name);
+		print_atoms(argc, argv);
+		printf("\n");
+		s_counting = counting;
+	}
+}
+
+// "123" -> long, "1.5" -> float, otherwise a symbol:
+static void atom_parse(t_atom * a, const char * s) {
+	char * end;
+	errno = 0;
+	long l = strtol(s, &end, 10);
+	if (*s && !*end && !errno) {
+		atom_setlong(a, l);
+		return;
+	}
+	double d = strtod(s, &end);
+	if (*s && !*end) {
+		atom_setfloat(a, d);
+		return;
+	}
+	atom_setsym(a, gensym(s));
+}
+
+static int pnm_token(FILE * f) {
+	int c, v = 0;
+	while ((c = fgetc(f)) != EOF) {
+		if (c == '#') {
+			while ((c = fgetc(f)) != EOF && c != '\n') {}
+		} else if (c >= '0' && c <= '9') {
+			break;
+		}
+	}
+	for (; c >= '0' && c <= '9'; c = fgetc(f)) v = v*10 + (c - '0');
+	return v;
+}
+
+// binary PGM -> 1-plane char matrix, binary PPM -> 4-plane ARGB char matrix:
+static t_symbol * load_pnm(const char * path) {
+	FILE * f = fopen(path, "rb");
+	if (!f) return 0;
+
+	char magic[3] = { 0, 0, 0 };
+	if (fread(magic, 1, 2, f) != 2 || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6')) {
+		fclose(f);
+		return 0;
+	}
+	bool colour = magic[1] == '6';
+	int width = pnm_token(f);
+	int height = pnm_token(f);
+	int maxval = pnm_token(f);
+	if (width <= 0 || height <= 0 || maxval != 255) {
+		fclose(f);
+		return 0;
+	}
+
+	t_jit_matrix_info info;
+	jit_matrix_info_default(&info);
+	info.type = _jit_sym_char;
+	info.planecount = colour ? 4 : 1;
+	info.dimcount = 2;
+	info.dim[0] = width;
+	info.dim[1] = height;
+
+	void * m;
+	t_symbol * name = headless_matrix_new(&info, &m);
+	char * bp;
+	jit_object_method(m, _jit_sym_getinfo, &info);
+	jit_object_method(m, _jit_sym_getdata, &bp);
+
+	std::vector<unsigned char> row(width * (colour ? 3 : 1));
+	for (int y=0; y<height; y++) {
+		if (fread(&row[0], 1, row.size(), f) != row.size()) break;
+		unsigned char * out = (unsigned char *)bp + y*info.dimstride[1];
+		if (colour) {
+			for (int x=0; x<width; x++) {
+				out[4*x] = 255;
+				out[4*x+1] = row[3*x];
+				out[4*x+2] = row[3*x+1];
+				out[4*x+3] = row[3*x+2];
+			}
+		} else {
+			memcpy(out, &row[0], width);
+		}
+	}
+	fclose(f);
+	return name;
+}
+
+// text point grid -> 2 or 3 plane float32 matrix:
+static t_symbol * load_pts(const char * path) {
+	FILE * f = fopen(path, "r");
+	if (!f) return 0;
+
+	int cols = 0, rows = 0;
+	if (fscanf(f, "%d %d", &cols, &rows) != 2 || cols <= 0 || rows <= 0) {
+		fclose(f);
+		return 0;
+	}
+	std::vector<float> values;
+	int planes = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		float v[3];
+		int n = sscanf(line, "%f %f %f", v, v+1, v+2);
+		if (n < 2) continue;
+		if (!planes) planes = n;
+		for (int i=0; i<planes; i++) values.push_back(i < n ? v[i] : 0.f);
+	}
+	fclose(f);
+	if ((long)values.size() < (long)cols*rows*planes) return 0;
+
+	t_jit_matrix_info info;
+	jit_matrix_info_default(&info);
+	info.type = _jit_sym_float32;
+	info.planecount = planes;
+	info.dimcount = 2;
+	info.dim[0] = cols;
+	info.dim[1] = rows;
+
+	void * m;
+	t_symbol * name = headless_matrix_new(&info, &m);
+	char * bp;
+	jit_object_method(m, _jit_sym_getinfo, &info);
+	jit_object_method(m, _jit_sym_getdata, &bp);
+	for (int y=0, i=0; y<rows; y++) {
+		for (int x=0; x<cols; x++) {
+			float * cell = (float *)(bp + y*info.dimstride[1] + x*info.dimstride[0]);
+			for (int p=0; p<planes; p++) cell[p] = values[i++];
+		}
+	}
+	return name;
+}
+
+// frames are told apart from attribute values by their extension:
+static bool is_frame(const std::string& arg) {
+	size_t dot = arg.rfind('.');
+	if (dot == std::string::npos) return false;
+	std::string ext = arg.substr(dot + 1);
+	return ext == "pgm" || ext == "ppm" || ext == "pts";
+}
+
+static double percentile(std::vector<double> v, double p) {
+	if (v.empty()) return 0;
+	std::sort(v.begin(), v.end());
+	size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+	return v[i];
+}
+
+static double mean(const std::vector<long>& v) {
+	if (v.empty()) return 0;
+	double sum = 0;
+	for (size_t i=0; i<v.size(); i++) sum += v[i];
+	return sum / v.size();
+}
+
+static void report(const char * what, const std::vector<double>& latency, const std::vector<long>& allocs, const std::vector<long>& bytes) {
+	printf("%s: %lu runs, latency us: median %.1f, p95 %.1f, max %.1f; allocations: %.1f (%.0f bytes) per run\n",
+		what, (unsigned long)latency.size(),
+		percentile(latency, 0.5), percentile(latency, 0.95), percentile(latency, 1.0),
+		mean(allocs), mean(bytes));
+}
+
+static void usage(const char * argv0) {
+	fprintf(stderr, "usage: %s [-n count] [-warmup count] [-bang] [-bang-end] [-dsp blocks] [-path dir] [-v] [@attr values ...] [inlet:]frame ...\n", argv0);
+	exit(1);
+}
+
+int main(int argc, char ** argv) {
+	long passes = 1, warmup = 1, dsp_blocks = 0;
+	bool bang = false, bang_end = false;
+	std::vector<t_atom> args;
+	std::vector<t_frame> frames;
+	t_stats stats;
+	stats.verbose = false;
+
+	common_symbols_init();
+
+	for (int i=1; i<argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "-n" && i+1 < argc) passes = atol(argv[++i]);
+		else if (arg == "-warmup" && i+1 < argc) warmup = atol(argv[++i]);
+		else if (arg == "-bang") bang = true;
+		else if (arg == "-bang-end") bang_end = true;
+		else if (arg == "-dsp" && i+1 < argc) dsp_blocks = atol(argv[++i]);
+		else if (arg == "-path" && i+1 < argc) headless_add_search_path(argv[++i]);
+		else if (arg == "-v") stats.verbose = true;
+		else if (arg[0] == '-') usage(argv[0]);
+		else if (arg[0] == '@') {
+			// an attribute & its values:
+			t_atom a;
+			atom_setsym(&a, gensym(argv[i]));
+			args.push_back(a);
+			while (i+1 < argc && argv[i+1][0] != '@' && !(argv[i+1][0] == '-' && isalpha(argv[i+1][1])) && !is_frame(argv[i+1])) {
+				atom_parse(&a, argv[++i]);
+				args.push_back(a);
+			}
+		} else {
+			t_frame frame;
+			frame.inlet = 0;
+			frame.path = arg;
+			size_t colon = arg.find(':');
+			if (colon != std::string::npos && colon > 0 && arg.find_first_not_of("0123456789") == colon) {
+				frame.inlet = atol(arg.substr(0, colon).c_str());
+				frame.path = arg.substr(colon + 1);
+			}
+			std::string ext = frame.path.substr(frame.path.rfind('.') + 1);
+			frame.name = ext == "pts" ? load_pts(frame.path.c_str()) : load_pnm(frame.path.c_str());
+			if (!frame.name) {
+				fprintf(stderr, "could not load %s\n", frame.path.c_str());
+				return 1;
+			}
+			frames.push_back(frame);
+		}
+	}
+
+	// register & instantiate the external:
+	ext_main();
+	const char * classname = headless_registered_class();
+	headless_set_outlet_handler(on_outlet, &stats);
+
+	s_counting = 1;
+	s_allocs = s_alloc_bytes = 0;
+	double t0 = now_us();
+	void * x = headless_new(classname, args.size(), args.empty() ? 0 : &args[0]);
+	double t1 = now_us();
+	s_counting = 0;
+	if (!x) {
+		fprintf(stderr, "could not create %s\n", classname);
+		return 1;
+	}
+	printf("%s: created in %.1f us, %ld allocations (%ld bytes)\n", classname, t1 - t0, s_allocs, s_alloc_bytes);
+
+	// frames:
+	std::vector<double> latency;
+	std::vector<long> allocs, bytes;
+	for (long pass = -warmup; pass < passes && !frames.empty(); pass++) {
+		for (size_t i=0; i<frames.size(); i++) {
+			t_atom a;
+			atom_setsym(&a, frames[i].name);
+
+			s_allocs = s_alloc_bytes = 0;
+			s_counting = pass >= 0;
+			t0 = now_us();
+			headless_send(x, frames[i].inlet, _jit_sym_jit_matrix, 1, &a);
+			if (bang) headless_send(x, 0, _sym_bang, 0, 0);
+			headless_service();
+			t1 = now_us();
+			s_counting = 0;
+
+			if (pass >= 0) {
+				latency.push_back(t1 - t0);
+				allocs.push_back((long)s_allocs);
+				bytes.push_back((long)s_alloc_bytes);
+			}
+		}
+	}
+	if (!latency.empty()) report("frame", latency, allocs, bytes);
+
+	if (bang_end) {
+		s_allocs = s_alloc_bytes = 0;
+		s_counting = 1;
+		t0 = now_us();
+		headless_send(x, 0, _sym_bang, 0, 0);
+		headless_service();
+		t1 = now_us();
+		s_counting = 0;
+		printf("bang: %.1f us, %ld allocations (%ld bytes)\n", t1 - t0, s_allocs, s_alloc_bytes);
+	}
+
+	// audio:
+	if (dsp_blocks > 0 && !headless_dsp_start(x, 44100, 64)) {
+		long nins = headless_dsp_numins(x), nouts = headless_dsp_numouts(x);
+		std::vector<double> buffers((nins + nouts) * 64, 0.);
+		std::vector<double *> ins(nins + 1), outs(nouts + 1);
+		for (long i=0; i<nins; i++) ins[i] = &buffers[i*64];
+		for (long i=0; i<nouts; i++) outs[i] = &buffers[(nins + i)*64];
+
+		std::vector<double> block_latency;
+		std::vector<long> block_allocs, block_bytes;
+		for (long b=0; b<dsp_blocks; b++) {
+			for (long i=0; i<nins; i++) {
+				for (long s=0; s<64; s++) ins[i][s] = (double)rand() / RAND_MAX * 2. - 1.;
+			}
+			s_allocs = s_alloc_bytes = 0;
+			s_counting = 1;
+			t0 = now_us();
+			headless_dsp_tick(x, &ins[0], &outs[0]);
+			t1 = now_us();
+			s_counting = 0;
+			block_latency.push_back(t1 - t0);
+			block_allocs.push_back((long)s_allocs);
+			block_bytes.push_back((long)s_alloc_bytes);
+		}
+		report("dsp block", block_latency, block_allocs, block_bytes);
+	}
+
+	for (size_t i=0; i<stats.outlet_messages.size(); i++) {
+		printf("outlet %lu: %ld messages\n", (unsigned long)i, stats.outlet_messages[i]);
+	}
+
+	object_free(x);
+	long errors = headless_error_count();
+	if (errors) printf("%ld errors\n", errors);
+	return errors ? 2 : 0;
+}
+
+// Count heap allocations from every thread by interposing the glibc allocator;
+// operator new and OpenCV's fastMalloc both end up here.
+
+extern "C" {
+	void *__libc_malloc(size_t size);
+	void *__libc_calloc(size_t n, size_t size);
+	void *__libc_realloc(void *p, size_t size);
+	void *__libc_memalign(size_t alignment, size_t size);
+	void __libc_free(void *p);
+}
+
+static inline void count_alloc(size_t size) {
+	if (s_counting) {
+		__sync_add_and_fetch(&s_allocs, 1);
+		__sync_add_and_fetch(&s_alloc_bytes, (long)size);
+	}
+}
+
+extern "C" void *malloc(size_t size) {
+	count_alloc(size);
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+	count_alloc(n * size);
+	return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *p, size_t size) {
+	count_alloc(size);
+	return __libc_realloc(p, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size) {
+	count_alloc(size);
+	return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **p, size_t alignment, size_t size) {
+	count_alloc(size);
+	*p = __libc_memalign(alignment, size);
+	return *p ? 0 : ENOMEM;
+}
+
+extern "C" void free(void *p) {
+	__libc_free(p);
+}
@@ -0,0 +1,1413 @@
+/*
+	Headless stand-in for the Max/Jitter API: enough of the object model,
+	matrices, outlets, attributes, qelems, threads and files for the externals
+	in this repository to run outside Max. See headless.h for the driver side.
+*/
+
+#include "headless.h"
+#include "z_dsp.h"
+#include "jit.gl.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+enum e_kind {
+	KIND_EXTERNAL,
+	KIND_MATRIX,
+	KIND_WRAPPER,
+	KIND_OUTLET,
+	KIND_PROXY,
+	KIND_QELEM,
+	KIND_FILEWATCHER,
+	KIND_DSP
+};
+
+struct t_headless_method {
+	method fn;
+	long type;
+};
+
+struct t_headless_attr {
+	t_symbol * name;
+	std::string type;
+	long offset, size, count;
+	method getter, setter;
+	bool hasmin, hasmax;
+	double min, max;
+};
+
+struct _class {
+	e_kind kind;
+	std::string name;
+	method mnew, mfree;
+	long size;
+	long newtype;
+	std::map<t_symbol *, t_headless_method> methods;
+	std::map<t_symbol *, t_headless_attr *> attrs;
+};
+
+struct t_headless_matrix {
+	t_object ob;
+	t_jit_matrix_info info;
+	char * data;
+	long lock;
+	t_symbol * name;
+};
+
+struct t_headless_wrapper {
+	t_object ob;
+	t_headless_matrix * matrix;
+};
+
+struct t_headless_outlet {
+	t_object ob;
+	void * owner;
+	long created;		// creation order; Max numbers outlets from the left, i.e. in reverse
+	t_symbol * type;
+};
+
+struct t_headless_proxy {
+	t_object ob;
+	void * owner;
+	long id;
+	long * stuffloc;
+};
+
+struct t_headless_qelem {
+	t_object ob;
+	void * obj;
+	method fn;
+	int set;
+};
+
+struct t_headless_dsp {
+	t_object ob;
+	void * owner;
+};
+
+// what the stand-in tracks for each external instance:
+struct t_instance {
+	std::vector<t_headless_outlet *> outlets;
+	std::vector<t_headless_proxy *> proxies;
+	long inlet;
+	long signal_ins, signal_outs;
+
+	t_headless_dsp * dsp;
+	t_perfroutine64 perform;
+	long perform_flags;
+	void * perform_userparam;
+	long vectorsize;
+
+	t_instance() : inlet(0), signal_ins(0), signal_outs(0), dsp(0), perform(0), perform_flags(0), perform_userparam(0), vectorsize(0) {}
+};
+
+static t_class s_matrix_class, s_wrapper_class, s_outlet_class, s_proxy_class, s_qelem_class, s_filewatcher_class, s_dsp_class;
+
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t s_main_thread = pthread_self();
+
+static std::map<std::string, t_symbol *> s_symbols;
+static std::map<std::string, t_class *> s_classes;
+static std::string s_registered;
+static std::set<void *> s_live;
+static std::map<void *, t_instance> s_instances;
+static std::map<t_symbol *, void *> s_registry;
+static std::vector<t_headless_qelem *> s_pending;
+static std::vector<std::string> s_paths(1, ".");
+
+static headless_outlet_fn s_outlet_fn = 0;
+static void * s_outlet_ctx = 0;
+static long s_errors = 0;
+static long s_unique = 0;
+
+// the typed views of method pointers that dispatch needs:
+typedef void *(*method_x)(void *);
+typedef void *(*method_long)(void *, long);
+typedef void *(*method_double)(void *, double);
+typedef void *(*method_sym)(void *, t_symbol *);
+typedef void *(*method_gimme)(void *, t_symbol *, long, t_atom *);
+typedef void *(*method_cant)(void *, void *, void *, void *, void *, void *, void *);
+typedef void *(*method_new)(t_symbol *, long, t_atom *);
+typedef t_max_err (*method_attr_set)(void *, void *, long, t_atom *);
+typedef t_max_err (*method_attr_get)(void *, void *, long *, t_atom **);
+typedef void (*method_dsp64)(void *, void *, short *, double, long, long);
+typedef void *(*method_defer)(void *, t_symbol *, short, t_atom *);
+
+// symbols:
+
+t_symbol *_sym_nothing, *_sym_bang, *_sym_int, *_sym_float, *_sym_list, *_sym_count,
+	*_sym_attr_modified, *_sym_getname, *_sym_none, *_sym_box, *_sym_nobox, *_sym_anything;
+
+t_symbol *_jit_sym_nothing, *_jit_sym_char, *_jit_sym_long, *_jit_sym_float32, *_jit_sym_float64,
+	*_jit_sym_lock, *_jit_sym_getdata, *_jit_sym_getinfo, *_jit_sym_setinfo, *_jit_sym_setinfo_ex,
+	*_jit_sym_clear, *_jit_sym_frommatrix, *_jit_sym_getmatrix, *_jit_sym_name, *_jit_sym_jit_matrix,
+	*_jit_sym_bang;
+
+t_symbol *gensym(C74_CONST char *s) {
+	pthread_mutex_lock(&s_mutex);
+	t_symbol *& sym = s_symbols[s];
+	if (!sym) {
+		sym = new t_symbol;
+		sym->s_name = strdup(s);
+		sym->s_thing = 0;
+	}
+	t_symbol * result = sym;
+	pthread_mutex_unlock(&s_mutex);
+	return result;
+}
+
+static void builtin_class(t_class& c, e_kind kind, const char * name) {
+	c.kind = kind;
+	c.name = name;
+	c.mnew = c.mfree = 0;
+	c.size = 0;
+	c.newtype = A_NOTHING;
+}
+
+void common_symbols_init(void) {
+	if (_sym_nothing) return;
+
+	_sym_nothing = gensym("");
+	_sym_bang = gensym("bang");
+	_sym_int = gensym("int");
+	_sym_float = gensym("float");
+	_sym_list = gensym("list");
+	_sym_count = gensym("count");
+	_sym_attr_modified = gensym("attr_modified");
+	_sym_getname = gensym("getname");
+	_sym_none = gensym("none");
+	_sym_box = gensym("box");
+	_sym_nobox = gensym("nobox");
+	_sym_anything = gensym("anything");
+
+	_jit_sym_nothing = _sym_nothing;
+	_jit_sym_char = gensym("char");
+	_jit_sym_long = gensym("long");
+	_jit_sym_float32 = gensym("float32");
+	_jit_sym_float64 = gensym("float64");
+	_jit_sym_lock = gensym("lock");
+	_jit_sym_getdata = gensym("getdata");
+	_jit_sym_getinfo = gensym("getinfo");
+	_jit_sym_setinfo = gensym("setinfo");
+	_jit_sym_setinfo_ex = gensym("setinfo_ex");
+	_jit_sym_clear = gensym("clear");
+	_jit_sym_frommatrix = gensym("frommatrix");
+	_jit_sym_getmatrix = gensym("getmatrix");
+	_jit_sym_name = gensym("name");
+	_jit_sym_jit_matrix = gensym("jit_matrix");
+	_jit_sym_bang = _sym_bang;
+
+	builtin_class(s_matrix_class, KIND_MATRIX, "jit_matrix");
+	builtin_class(s_wrapper_class, KIND_WRAPPER, "jit_matrix_wrapper");
+	builtin_class(s_outlet_class, KIND_OUTLET, "outlet");
+	builtin_class(s_proxy_class, KIND_PROXY, "proxy");
+	builtin_class(s_qelem_class, KIND_QELEM, "qelem");
+	builtin_class(s_filewatcher_class, KIND_FILEWATCHER, "filewatcher");
+	builtin_class(s_dsp_class, KIND_DSP, "dsp64");
+}
+
+// console:
+
+static t_class * live_class(void * x);
+
+static void vpost(const char * prefix, t_object * x, const char * fmt, va_list ap) {
+	t_class * c = live_class(x);
+	if (c) fprintf(stderr, "%s: ", c->name.c_str());
+	fputs(prefix, stderr);
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+}
+
+void post(C74_CONST char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vpost("", 0, fmt, ap);
+	va_end(ap);
+}
+
+void error(C74_CONST char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vpost("error: ", 0, fmt, ap);
+	va_end(ap);
+	__sync_add_and_fetch(&s_errors, 1);
+}
+
+void object_post(t_object *x, C74_CONST char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vpost("", x, fmt, ap);
+	va_end(ap);
+}
+
+void object_warn(t_object *x, C74_CONST char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vpost("warning: ", x, fmt, ap);
+	va_end(ap);
+}
+
+void object_error(t_object *x, C74_CONST char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vpost("error: ", x, fmt, ap);
+	va_end(ap);
+	__sync_add_and_fetch(&s_errors, 1);
+}
+
+long headless_error_count(void) {
+	return s_errors;
+}
+
+// objects:
+
+static t_object * live_new(t_class * c, size_t size) {
+	t_object * x = (t_object *)calloc(1, size);
+	x->o_class = c;
+	pthread_mutex_lock(&s_mutex);
+	s_live.insert(x);
+	pthread_mutex_unlock(&s_mutex);
+	return x;
+}
+
+static t_class * live_class(void * x) {
+	t_class * c = 0;
+	pthread_mutex_lock(&s_mutex);
+	if (x && s_live.count(x)) c = ((t_object *)x)->o_class;
+	pthread_mutex_unlock(&s_mutex);
+	return c;
+}
+
+static void live_free(void * x) {
+	pthread_mutex_lock(&s_mutex);
+	s_live.erase(x);
+	pthread_mutex_unlock(&s_mutex);
+	free(x);
+}
+
+t_class *class_new(C74_CONST char *name, C74_CONST method mnew, C74_CONST method mfree, long size, C74_CONST method mmenu, short type, ...) {
+	t_class * c = new t_class;
+	c->kind = KIND_EXTERNAL;
+	c->name = name;
+	c->mnew = mnew;
+	c->mfree = mfree;
+	c->size = size;
+	c->newtype = type;
+	return c;
+}
+
+t_max_err class_addmethod(t_class *c, C74_CONST method m, C74_CONST char *name, ...) {
+	va_list ap;
+	va_start(ap, name);
+	t_headless_method& hm = c->methods[gensym(name)];
+	hm.fn = m;
+	hm.type = va_arg(ap, int);
+	va_end(ap);
+	return MAX_ERR_NONE;
+}
+
+t_jit_err jit_class_addmethod(void *c, method m, C74_CONST char *name, ...) {
+	va_list ap;
+	va_start(ap, name);
+	t_headless_method& hm = ((t_class *)c)->methods[gensym(name)];
+	hm.fn = m;
+	hm.type = va_arg(ap, int);
+	va_end(ap);
+	return JIT_ERR_NONE;
+}
+
+t_max_err class_register(t_symbol *name_space, t_class *c) {
+	s_classes[c->name] = c;
+	s_registered = c->name;
+	return MAX_ERR_NONE;
+}
+
+C74_CONST char *headless_registered_class(void) {
+	return s_registered.c_str();
+}
+
+void *object_alloc(t_class *c) {
+	t_object * x = live_new(c, c->size);
+	pthread_mutex_lock(&s_mutex);
+	s_instances[x];
+	pthread_mutex_unlock(&s_mutex);
+	return x;
+}
+
+void *headless_new(C74_CONST char *classname, long argc, t_atom *argv) {
+	std::map<std::string, t_class *>::iterator it = s_classes.find(classname);
+	if (it == s_classes.end()) {
+		error("no class %s", classname);
+		return 0;
+	}
+	t_class * c = it->second;
+	if (c->newtype == A_GIMME) {
+		return ((method_new)c->mnew)(gensym(classname), argc, argv);
+	}
+	return ((method_x)c->mnew)(0);
+}
+
+static void matrix_free(t_headless_matrix * m);
+
+t_max_err object_free(void *x) {
+	t_class * c = live_class(x);
+	if (!c) return MAX_ERR_INVALID_PTR;
+
+	switch (c->kind) {
+		case KIND_EXTERNAL: {
+			if (c->mfree) ((method_x)c->mfree)(x);
+
+			t_instance inst;
+			pthread_mutex_lock(&s_mutex);
+			inst = s_instances[x];
+			s_instances.erase(x);
+			pthread_mutex_unlock(&s_mutex);
+
+			for (size_t i=0; i<inst.outlets.size(); i++) live_free(inst.outlets[i]);
+			for (size_t i=0; i<inst.proxies.size(); i++) live_free(inst.proxies[i]);
+			if (inst.dsp) live_free(inst.dsp);
+			live_free(x);
+		} break;
+		case KIND_MATRIX:
+			matrix_free((t_headless_matrix *)x);
+			break;
+		case KIND_WRAPPER:
+			matrix_free(((t_headless_wrapper *)x)->matrix);
+			live_free(x);
+			break;
+		case KIND_QELEM:
+			qelem_free(x);
+			break;
+		case KIND_OUTLET:
+		case KIND_PROXY:
+		case KIND_DSP:
+			// owned by the instance
+			break;
+		default:
+			live_free(x);
+			break;
+	}
+	return MAX_ERR_NONE;
+}
+
+t_max_err object_notify(void *x, t_symbol *s, void *data) {
+	return MAX_ERR_NONE;
+}
+
+static t_instance * instance(void * x) {
+	pthread_mutex_lock(&s_mutex);
+	std::map<void *, t_instance>::iterator it = s_instances.find(x);
+	t_instance * inst = it == s_instances.end() ? 0 : &it->second;
+	pthread_mutex_unlock(&s_mutex);
+	return inst;
+}
+
+// matrices:
+
+static long matrix_typesize(t_symbol * type) {
+	if (type == _jit_sym_char) return 1;
+	if (type == _jit_sym_float64) return 8;
+	return 4;	// long & float32
+}
+
+static void matrix_setinfo(t_headless_matrix * m, const t_jit_matrix_info * in) {
+	t_jit_matrix_info& info = m->info;
+	long oldsize = info.size;
+
+	info.type = in->type ? in->type : _jit_sym_char;
+	info.flags = in->flags;
+	info.planecount = std::max(1L, std::min(in->planecount, (long)JIT_MATRIX_MAX_PLANECOUNT));
+	info.dimcount = std::max(1L, std::min(in->dimcount, (long)JIT_MATRIX_MAX_DIMCOUNT));
+
+	// rows are padded to 16 bytes unless packed tight:
+	for (long i=0; i<info.dimcount; i++) {
+		info.dim[i] = std::max(1L, in->dim[i]);
+		if (i == 0) {
+			info.dimstride[0] = matrix_typesize(info.type) * info.planecount;
+		} else {
+			info.dimstride[i] = info.dimstride[i-1] * info.dim[i-1];
+			if (i == 1 && !(info.flags & JIT_MATRIX_DATA_PACK_TIGHT)) {
+				info.dimstride[1] = (info.dimstride[1] + 15) & ~15L;
+			}
+		}
+	}
+	info.size = info.dimstride[info.dimcount-1] * info.dim[info.dimcount-1];
+
+	if (!m->data || info.size != oldsize) {
+		free(m->data);
+		m->data = (char *)calloc(1, info.size);
+	}
+}
+
+static t_headless_matrix * matrix_new(const t_jit_matrix_info * info) {
+	t_headless_matrix * m = (t_headless_matrix *)live_new(&s_matrix_class, sizeof(t_headless_matrix));
+	t_jit_matrix_info def;
+	if (!info) {
+		jit_matrix_info_default(&def);
+		info = &def;
+	}
+	matrix_setinfo(m, info);
+	m->name = _jit_sym_nothing;
+	return m;
+}
+
+static void matrix_free(t_headless_matrix * m) {
+	if (!m) return;
+	jit_object_unregister(m);
+	free(m->data);
+	live_free(m);
+}
+
+// copy the overlapping region of src, cell by cell where the layouts differ:
+static void matrix_frommatrix(t_headless_matrix * dst, t_headless_matrix * src) {
+	const t_jit_matrix_info& di = dst->info;
+	const t_jit_matrix_info& si = src->info;
+	if (di.type != si.type) {
+		error("jit_matrix: frommatrix between types is not supported headless");
+		return;
+	}
+	long ts = matrix_typesize(di.type);
+	long planes = std::min(di.planecount, si.planecount);
+	long width = std::min(di.dim[0], si.dim[0]);
+	long height = std::min(di.dimcount > 1 ? di.dim[1] : 1, si.dimcount > 1 ? si.dim[1] : 1);
+
+	for (long y=0; y<height; y++) {
+		char * d = dst->data + y*(di.dimcount > 1 ? di.dimstride[1] : 0);
+		const char * s = src->data + y*(si.dimcount > 1 ? si.dimstride[1] : 0);
+		if (di.planecount == si.planecount) {
+			memcpy(d, s, width * di.dimstride[0]);
+		} else {
+			for (long x=0; x<width; x++) {
+				memcpy(d + x*di.dimstride[0], s + x*si.dimstride[0], planes * ts);
+			}
+		}
+	}
+}
+
+static void * matrix_method(t_headless_matrix * m, t_symbol * s, va_list ap) {
+	if (s == _jit_sym_lock) {
+		long old = m->lock;
+		m->lock = (int)va_arg(ap, long);
+		return (void *)old;
+	} else if (s == _jit_sym_getdata) {
+		char ** p = va_arg(ap, char **);
+		if (p) *p = m->data;
+	} else if (s == _jit_sym_getinfo) {
+		t_jit_matrix_info * info = va_arg(ap, t_jit_matrix_info *);
+		if (info) *info = m->info;
+	} else if (s == _jit_sym_setinfo || s == _jit_sym_setinfo_ex) {
+		t_jit_matrix_info * info = va_arg(ap, t_jit_matrix_info *);
+		if (info) matrix_setinfo(m, info);
+	} else if (s == _jit_sym_clear) {
+		memset(m->data, 0, m->info.size);
+	} else if (s == _jit_sym_frommatrix) {
+		void * src = va_arg(ap, void *);
+		if (live_class(src) == &s_matrix_class) matrix_frommatrix(m, (t_headless_matrix *)src);
+		else if (live_class(src) == &s_wrapper_class) matrix_frommatrix(m, ((t_headless_wrapper *)src)->matrix);
+		else return (void *)JIT_ERR_INVALID_INPUT;
+	} else if (s == _jit_sym_getmatrix) {
+		return m;
+	} else {
+		error("jit_matrix: no method %s", s->s_name);
+		return (void *)JIT_ERR_GENERIC;
+	}
+	return (void *)JIT_ERR_NONE;
+}
+
+void *jit_object_new(t_symbol *classname, ...) {
+	va_list ap;
+	va_start(ap, classname);
+	void * x = 0;
+	if (classname == _jit_sym_jit_matrix) {
+		x = matrix_new(va_arg(ap, t_jit_matrix_info *));
+	} else if (classname == gensym("jit_matrix_wrapper")) {
+		t_symbol * name = va_arg(ap, t_symbol *);
+		t_headless_wrapper * w = (t_headless_wrapper *)live_new(&s_wrapper_class, sizeof(t_headless_wrapper));
+		w->matrix = matrix_new(0);
+		jit_object_register(w->matrix, name ? name : jit_symbol_unique());
+		x = w;
+	} else {
+		error("jit_object_new: no class %s headless", classname->s_name);
+	}
+	va_end(ap);
+	return x;
+}
+
+t_jit_err jit_object_free(void *x) {
+	return object_free(x);
+}
+
+void *jit_object_register(void *x, t_symbol *s) {
+	pthread_mutex_lock(&s_mutex);
+	void *& slot = s_registry[s];
+	if (!slot) slot = x;
+	void * result = slot;
+	pthread_mutex_unlock(&s_mutex);
+
+	if (result == x && live_class(x) == &s_matrix_class) ((t_headless_matrix *)x)->name = s;
+	return result;
+}
+
+void *jit_object_findregistered(t_symbol *s) {
+	pthread_mutex_lock(&s_mutex);
+	std::map<t_symbol *, void *>::iterator it = s_registry.find(s);
+	void * result = it == s_registry.end() ? 0 : it->second;
+	pthread_mutex_unlock(&s_mutex);
+	return result;
+}
+
+t_jit_err jit_object_unregister(void *x) {
+	pthread_mutex_lock(&s_mutex);
+	for (std::map<t_symbol *, void *>::iterator it = s_registry.begin(); it != s_registry.end(); ++it) {
+		if (it->second == x) {
+			s_registry.erase(it);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&s_mutex);
+	return JIT_ERR_NONE;
+}
+
+t_symbol *jit_symbol_unique(void) {
+	char name[32];
+	snprintf(name, sizeof(name), "u%09ld", __sync_add_and_fetch(&s_unique, 1));
+	return gensym(name);
+}
+
+t_jit_err jit_error_code(void *x, t_jit_err v) {
+	if (v != JIT_ERR_NONE) {
+		char code[5] = { (char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v, 0 };
+		object_error((t_object *)x, "jit error %s", code);
+	}
+	return v;
+}
+
+t_jit_err jit_matrix_info_default(t_jit_matrix_info *info) {
+	memset(info, 0, sizeof(t_jit_matrix_info));
+	info->type = _jit_sym_char;
+	info->planecount = 1;
+	info->dimcount = 2;
+	info->dim[0] = info->dim[1] = 1;
+	return JIT_ERR_NONE;
+}
+
+t_symbol *headless_matrix_new(t_jit_matrix_info *info, void **matrix) {
+	t_headless_matrix * m = matrix_new(info);
+	jit_object_register(m, jit_symbol_unique());
+	if (matrix) *matrix = m;
+	return m->name;
+}
+
+// methods:
+
+static void * vmethod(void * x, t_symbol * s, va_list ap) {
+	t_class * c = live_class(x);
+	if (!c) {
+		error("method %s sent to unknown object %p", s->s_name, x);
+		return 0;
+	}
+
+	switch (c->kind) {
+		case KIND_MATRIX:
+			return matrix_method((t_headless_matrix *)x, s, ap);
+		case KIND_WRAPPER:
+			if (s == _jit_sym_getmatrix) return ((t_headless_wrapper *)x)->matrix;
+			return matrix_method(((t_headless_wrapper *)x)->matrix, s, ap);
+		case KIND_DSP:
+			if (s == gensym("dsp_add64")) {
+				void * owner = va_arg(ap, void *);
+				t_instance * inst = instance(owner);
+				if (inst) {
+					inst->perform = va_arg(ap, t_perfroutine64);
+					inst->perform_flags = (int)va_arg(ap, long);
+					inst->perform_userparam = va_arg(ap, void *);
+				}
+			}
+			return 0;
+		case KIND_EXTERNAL: {
+			std::map<t_symbol *, t_headless_method>::iterator it = c->methods.find(s);
+			if (it == c->methods.end()) return 0;
+
+			// A_CANT methods take whatever the caller passes; forward six words:
+			void * a[6];
+			for (int i=0; i<6; i++) a[i] = va_arg(ap, void *);
+			return ((method_cant)it->second.fn)(x, a[0], a[1], a[2], a[3], a[4], a[5]);
+		}
+		default:
+			return 0;
+	}
+}
+
+void *object_method(void *x, t_symbol *s, ...) {
+	va_list ap;
+	va_start(ap, s);
+	void * result = vmethod(x, s, ap);
+	va_end(ap);
+	return result;
+}
+
+// typed messages go through the same path as the driver's, into the current inlet:
+t_max_err object_method_typed(void *x, t_symbol *s, long ac, t_atom *av, t_atom *rv) {
+	t_instance * inst = instance(x);
+	return headless_send(x, inst ? inst->inlet : 0, s, ac, av);
+}
+
+void *jit_object_method(void *x, t_symbol *s, ...) {
+	va_list ap;
+	va_start(ap, s);
+	void * result = vmethod(x, s, ap);
+	va_end(ap);
+	return result;
+}
+
+// attributes:
+
+t_max_err headless_class_addattr(t_class *c, C74_CONST char *name, C74_CONST char *type, long offset, long size, long count) {
+	t_headless_attr * attr = new t_headless_attr;
+	attr->name = gensym(name);
+	attr->type = type;
+	attr->offset = offset;
+	attr->size = size;
+	attr->count = count;
+	attr->getter = attr->setter = 0;
+	attr->hasmin = attr->hasmax = false;
+	attr->min = attr->max = 0;
+	c->attrs[attr->name] = attr;
+	return MAX_ERR_NONE;
+}
+
+static t_headless_attr * find_attr(void * x, t_symbol * s) {
+	t_class * c = live_class(x);
+	if (!c) return 0;
+	std::map<t_symbol *, t_headless_attr *>::iterator it = c->attrs.find(s);
+	return it == c->attrs.end() ? 0 : it->second;
+}
+
+t_max_err headless_class_attr_accessors(t_class *c, C74_CONST char *name, method getter, method setter) {
+	std::map<t_symbol *, t_headless_attr *>::iterator it = c->attrs.find(gensym(name));
+	if (it == c->attrs.end()) return MAX_ERR_GENERIC;
+	it->second->getter = getter;
+	it->second->setter = setter;
+	return MAX_ERR_NONE;
+}
+
+t_max_err headless_class_attr_filter(t_class *c, C74_CONST char *name, long hasmin, double min, long hasmax, double max) {
+	std::map<t_symbol *, t_headless_attr *>::iterator it = c->attrs.find(gensym(name));
+	if (it == c->attrs.end()) return MAX_ERR_GENERIC;
+	if (hasmin) {
+		it->second->hasmin = true;
+		it->second->min = min;
+	}
+	if (hasmax) {
+		it->second->hasmax = true;
+		it->second->max = max;
+	}
+	return MAX_ERR_NONE;
+}
+
+static t_max_err attr_set(void * x, t_headless_attr * attr, long argc, t_atom * argv) {
+	if (attr->setter) return ((method_attr_set)attr->setter)(x, attr, argc, argv);
+
+	char * p = (char *)x + attr->offset;
+	long elem = attr->size / attr->count;
+	for (long i=0; i<argc && i<attr->count; i++, p += elem) {
+		double v = atom_getfloat(argv+i);
+		if (attr->hasmin && v < attr->min) v = attr->min;
+		if (attr->hasmax && v > attr->max) v = attr->max;
+
+		if (attr->type == "char") {
+			*(char *)p = (char)v;
+		} else if (attr->type == "long") {
+			t_atom_long l = (attr->hasmin || attr->hasmax) ? (t_atom_long)v : atom_getlong(argv+i);
+			if (elem == (long)sizeof(int)) *(int *)p = (int)l;
+			else *(t_atom_long *)p = l;
+		} else if (attr->type == "float32") {
+			*(float *)p = (float)v;
+		} else if (attr->type == "float64") {
+			*(double *)p = v;
+		} else if (attr->type == "symbol") {
+			*(t_symbol **)p = atom_getsym(argv+i);
+		} else if (attr->type == "object") {
+			*(void **)p = atom_getobj(argv+i);
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+// the first value of an attribute, as an atom:
+static bool attr_get(void * x, t_symbol * s, t_atom * out) {
+	t_headless_attr * attr = find_attr(x, s);
+	atom_setlong(out, 0);
+	if (!attr) return false;
+
+	if (attr->getter) {
+		long ac = 0;
+		t_atom * av = 0;
+		((method_attr_get)attr->getter)(x, attr, &ac, &av);
+		if (ac && av) *out = av[0];
+		sysmem_freeptr(av);
+		return true;
+	}
+
+	char * p = (char *)x + attr->offset;
+	long elem = attr->size / attr->count;
+	if (attr->type == "char") atom_setlong(out, *(char *)p);
+	else if (attr->type == "long") atom_setlong(out, elem == (long)sizeof(int) ? *(int *)p : *(t_atom_long *)p);
+	else if (attr->type == "float32") atom_setfloat(out, *(float *)p);
+	else if (attr->type == "float64") atom_setfloat(out, *(double *)p);
+	else if (attr->type == "symbol") atom_setsym(out, *(t_symbol **)p);
+	else if (attr->type == "object") atom_setobj(out, *(void **)p);
+	return true;
+}
+
+t_atom_long object_attr_getlong(void *x, t_symbol *s) {
+	t_atom a;
+	attr_get(x, s, &a);
+	return atom_getlong(&a);
+}
+
+t_symbol *object_attr_getsym(void *x, t_symbol *s) {
+	t_atom a;
+	attr_get(x, s, &a);
+	return atom_getsym(&a);
+}
+
+t_object *object_attr_getobj(void *x, t_symbol *s) {
+	t_atom a;
+	attr_get(x, s, &a);
+	return (t_object *)atom_getobj(&a);
+}
+
+t_max_err object_attr_setvalueof(void *x, t_symbol *s, long argc, t_atom *argv) {
+	t_headless_attr * attr = find_attr(x, s);
+	if (!attr) return MAX_ERR_GENERIC;
+	return attr_set(x, attr, argc, argv);
+}
+
+t_max_err attr_args_process(void *x, short ac, t_atom *av) {
+	for (long i=0; i<ac; i++) {
+		if (av[i].a_type != A_SYM || av[i].a_w.w_sym->s_name[0] != '@') continue;
+
+		long start = i+1, end = start;
+		while (end < ac && !(av[end].a_type == A_SYM && av[end].a_w.w_sym->s_name[0] == '@')) end++;
+
+		t_symbol * name = gensym(av[i].a_w.w_sym->s_name + 1);
+		if (object_attr_setvalueof(x, name, end - start, av + start)) {
+			object_error((t_object *)x, "doesn't understand attribute %s", name->s_name);
+		}
+		i = end - 1;
+	}
+	return MAX_ERR_NONE;
+}
+
+t_symbol *jit_attr_getsym(void *x, t_symbol *s) {
+	t_class * c = live_class(x);
+	if (s == _jit_sym_name) {
+		if (c == &s_matrix_class) return ((t_headless_matrix *)x)->name;
+		if (c == &s_wrapper_class) return ((t_headless_wrapper *)x)->matrix->name;
+	}
+	return object_attr_getsym(x, s);
+}
+
+t_jit_err jit_attr_setlong(void *x, t_symbol *s, t_atom_long c) {
+	t_atom a;
+	atom_setlong(&a, c);
+	return object_attr_setvalueof(x, s, 1, &a);
+}
+
+long jit_attr_getlong_array(void *x, t_symbol *s, long max, t_atom_long *vals) {
+	if (max < 1) return 0;
+	vals[0] = object_attr_getlong(x, s);
+	return 1;
+}
+
+// atoms:
+
+t_max_err atom_setlong(t_atom *a, t_atom_long b) {
+	a->a_type = A_LONG;
+	a->a_w.w_long = b;
+	return MAX_ERR_NONE;
+}
+
+t_max_err atom_setfloat(t_atom *a, double b) {
+	a->a_type = A_FLOAT;
+	a->a_w.w_float = (t_atom_float)b;
+	return MAX_ERR_NONE;
+}
+
+t_max_err atom_setsym(t_atom *a, t_symbol *b) {
+	a->a_type = A_SYM;
+	a->a_w.w_sym = b;
+	return MAX_ERR_NONE;
+}
+
+t_max_err atom_setobj(t_atom *a, void *b) {
+	a->a_type = A_OBJ;
+	a->a_w.w_obj = (t_object *)b;
+	return MAX_ERR_NONE;
+}
+
+t_atom_long atom_getlong(C74_CONST t_atom *a) {
+	switch (a->a_type) {
+		case A_LONG: return a->a_w.w_long;
+		case A_FLOAT: return (t_atom_long)a->a_w.w_float;
+		default: return 0;
+	}
+}
+
+t_atom_float atom_getfloat(C74_CONST t_atom *a) {
+	switch (a->a_type) {
+		case A_LONG: return (t_atom_float)a->a_w.w_long;
+		case A_FLOAT: return a->a_w.w_float;
+		default: return 0;
+	}
+}
+
+t_symbol *atom_getsym(C74_CONST t_atom *a) {
+	return a->a_type == A_SYM ? a->a_w.w_sym : _sym_nothing;
+}
+
+void *atom_getobj(C74_CONST t_atom *a) {
+	return a->a_type == A_OBJ ? a->a_w.w_obj : 0;
+}
+
+long atom_gettype(C74_CONST t_atom *a) {
+	return a->a_type;
+}
+
+t_max_err atom_setdouble_array(long ac, t_atom *av, long count, double *vals) {
+	for (long i=0; i<ac && i<count; i++) atom_setfloat(av+i, vals[i]);
+	return MAX_ERR_NONE;
+}
+
+t_max_err atom_alloc(long *ac, t_atom **av, char *alloc) {
+	if (*ac && *av) {
+		*alloc = 0;
+	} else {
+		*ac = 1;
+		*av = (t_atom *)sysmem_newptrclear(sizeof(t_atom));
+		*alloc = 1;
+	}
+	return MAX_ERR_NONE;
+}
+
+// inlets & outlets:
+
+void headless_set_outlet_handler(headless_outlet_fn fn, void *ctx) {
+	s_outlet_fn = fn;
+	s_outlet_ctx = ctx;
+}
+
+void *outlet_new(void *x, C74_CONST char *type) {
+	t_instance * inst = instance(x);
+	if (!inst) return 0;
+
+	t_headless_outlet * o = (t_headless_outlet *)live_new(&s_outlet_class, sizeof(t_headless_outlet));
+	o->owner = x;
+	o->created = inst->outlets.size();
+	o->type = type ? gensym(type) : _sym_nothing;
+	inst->outlets.push_back(o);
+	if (type && !strcmp(type, "signal")) inst->signal_outs++;
+	return o;
+}
+
+void *listout(void *x) { return outlet_new(x, "list"); }
+void *bangout(void *x) { return outlet_new(x, "bang"); }
+void *intout(void *x) { return outlet_new(x, "int"); }
+void *floatout(void *x) { return outlet_new(x, "float"); }
+
+static void *outlet_send(void *o, t_symbol *s, long ac, t_atom *av) {
+	if (live_class(o) != &s_outlet_class) return 0;
+	t_headless_outlet * outlet = (t_headless_outlet *)o;
+
+	if (s_outlet_fn) {
+		t_instance * inst = instance(outlet->owner);
+		long index = inst ? (long)inst->outlets.size() - 1 - outlet->created : 0;
+		s_outlet_fn(s_outlet_ctx, outlet->owner, index, s, ac, av);
+	}
+	return o;
+}
+
+void *outlet_bang(void *o) {
+	return outlet_send(o, _sym_bang, 0, 0);
+}
+
+void *outlet_int(void *o, t_atom_long n) {
+	t_atom a;
+	atom_setlong(&a, n);
+	return outlet_send(o, _sym_int, 1, &a);
+}
+
+void *outlet_float(void *o, double f) {
+	t_atom a;
+	atom_setfloat(&a, f);
+	return outlet_send(o, _sym_float, 1, &a);
+}
+
+void *outlet_list(void *o, t_symbol *s, short ac, t_atom *av) {
+	return outlet_send(o, _sym_list, ac, av);
+}
+
+void *outlet_anything(void *o, t_symbol *s, short ac, t_atom *av) {
+	return outlet_send(o, s, ac, av);
+}
+
+void *proxy_new(void *x, long id, long *stuffloc) {
+	t_instance * inst = instance(x);
+	if (!inst) return 0;
+
+	t_headless_proxy * p = (t_headless_proxy *)live_new(&s_proxy_class, sizeof(t_headless_proxy));
+	p->owner = x;
+	p->id = id;
+	p->stuffloc = stuffloc;
+	inst->proxies.push_back(p);
+	return p;
+}
+
+long proxy_getinlet(t_object *master) {
+	t_instance * inst = instance(master);
+	return inst ? inst->inlet : 0;
+}
+
+t_max_err headless_send(void *x, long inlet, t_symbol *s, long argc, t_atom *argv) {
+	t_class * c = live_class(x);
+	t_instance * inst = instance(x);
+	if (!c || !inst) return MAX_ERR_INVALID_PTR;
+
+	inst->inlet = inlet;
+	for (size_t i=0; i<inst->proxies.size(); i++) {
+		if (inst->proxies[i]->id == inlet && inst->proxies[i]->stuffloc) *inst->proxies[i]->stuffloc = inlet;
+	}
+
+	std::map<t_symbol *, t_headless_method>::iterator it = c->methods.find(s);
+	if (it == c->methods.end()) {
+		// an attribute?
+		t_headless_attr * attr = find_attr(x, s);
+		if (attr) return attr_set(x, attr, argc, argv);
+
+		it = c->methods.find(gensym("anything"));
+		if (it == c->methods.end()) {
+			object_error((t_object *)x, "doesn't understand \"%s\"", s->s_name);
+			return MAX_ERR_GENERIC;
+		}
+	}
+
+	method fn = it->second.fn;
+	switch (it->second.type) {
+		case A_GIMME:
+			((method_gimme)fn)(x, s, argc, argv);
+			break;
+		case A_SYM:
+		case A_DEFSYM:
+			((method_sym)fn)(x, argc ? atom_getsym(argv) : _sym_nothing);
+			break;
+		case A_LONG:
+		case A_DEFLONG:
+			((method_long)fn)(x, argc ? atom_getlong(argv) : 0);
+			break;
+		case A_FLOAT:
+		case A_DEFFLOAT:
+			((method_double)fn)(x, argc ? atom_getfloat(argv) : 0.);
+			break;
+		case A_CANT:
+			object_error((t_object *)x, "method %s can't be sent as a message", s->s_name);
+			return MAX_ERR_GENERIC;
+		default:
+			((method_x)fn)(x);
+			break;
+	}
+	return MAX_ERR_NONE;
+}
+
+// scheduling:
+
+void *qelem_new(void *obj, method fn) {
+	t_headless_qelem * q = (t_headless_qelem *)live_new(&s_qelem_class, sizeof(t_headless_qelem));
+	q->obj = obj;
+	q->fn = fn;
+	return q;
+}
+
+void qelem_set(void *q) {
+	t_headless_qelem * qe = (t_headless_qelem *)q;
+	pthread_mutex_lock(&s_mutex);
+	if (!qe->set) {
+		qe->set = 1;
+		s_pending.push_back(qe);
+	}
+	pthread_mutex_unlock(&s_mutex);
+}
+
+void qelem_unset(void *q) {
+	pthread_mutex_lock(&s_mutex);
+	((t_headless_qelem *)q)->set = 0;
+	pthread_mutex_unlock(&s_mutex);
+}
+
+void qelem_free(void *q) {
+	pthread_mutex_lock(&s_mutex);
+	s_pending.erase(std::remove(s_pending.begin(), s_pending.end(), (t_headless_qelem *)q), s_pending.end());
+	pthread_mutex_unlock(&s_mutex);
+	live_free(q);
+}
+
+long headless_service(void) {
+	long ran = 0;
+	while (1) {
+		t_headless_qelem * q = 0;
+		pthread_mutex_lock(&s_mutex);
+		if (!s_pending.empty()) {
+			q = s_pending.front();
+			s_pending.erase(s_pending.begin());
+			if (q->set) q->set = 0;
+			else q = 0;
+		}
+		bool more = !s_pending.empty();
+		pthread_mutex_unlock(&s_mutex);
+
+		if (q) {
+			((method_x)q->fn)(q->obj);
+			ran++;
+		}
+		if (!q && !more) break;
+	}
+	return ran;
+}
+
+// there is only one thread servicing messages, so run deferred calls immediately:
+void *defer(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv) {
+	((method_defer)fn)(ob, sym, argc, argv);
+	return 0;
+}
+
+void *defer_low(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv) {
+	((method_defer)fn)(ob, sym, argc, argv);
+	return 0;
+}
+
+double systimer_gettime(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+// threads:
+
+struct t_headless_thread {
+	pthread_t thread;
+	method fn;
+	void * arg;
+};
+
+static void * thread_main(void * p) {
+	t_headless_thread * t = (t_headless_thread *)p;
+	t->fn(t->arg);
+	return 0;
+}
+
+long systhread_create(method entryproc, void *arg, long stacksize, long priority, long flags, t_systhread *thread) {
+	t_headless_thread * t = new t_headless_thread;
+	t->fn = entryproc;
+	t->arg = arg;
+	if (pthread_create(&t->thread, 0, thread_main, t)) {
+		delete t;
+		return MAX_ERR_GENERIC;
+	}
+	*thread = t;
+	return MAX_ERR_NONE;
+}
+
+long systhread_join(t_systhread thread, unsigned int *retval) {
+	t_headless_thread * t = (t_headless_thread *)thread;
+	if (!t) return MAX_ERR_INVALID_PTR;
+	pthread_join(t->thread, 0);
+	if (retval) *retval = 0;
+	delete t;
+	return MAX_ERR_NONE;
+}
+
+void systhread_exit(long status) {
+	pthread_exit(0);
+}
+
+short systhread_ismainthread(void) {
+	return pthread_equal(pthread_self(), s_main_thread) ? 1 : 0;
+}
+
+long systhread_mutex_new(t_systhread_mutex *pmutex, long flags) {
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	if (flags & SYSTHREAD_MUTEX_RECURSIVE) pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_t * m = new pthread_mutex_t;
+	pthread_mutex_init(m, &attr);
+	pthread_mutexattr_destroy(&attr);
+	*pmutex = m;
+	return MAX_ERR_NONE;
+}
+
+long systhread_mutex_free(t_systhread_mutex pmutex) {
+	pthread_mutex_destroy((pthread_mutex_t *)pmutex);
+	delete (pthread_mutex_t *)pmutex;
+	return MAX_ERR_NONE;
+}
+
+long systhread_mutex_lock(t_systhread_mutex pmutex) {
+	return pthread_mutex_lock((pthread_mutex_t *)pmutex);
+}
+
+long systhread_mutex_unlock(t_systhread_mutex pmutex) {
+	return pthread_mutex_unlock((pthread_mutex_t *)pmutex);
+}
+
+long systhread_mutex_trylock(t_systhread_mutex pmutex) {
+	return pthread_mutex_trylock((pthread_mutex_t *)pmutex);
+}
+
+long systhread_cond_new(t_systhread_cond *pcond, long flags) {
+	pthread_cond_t * c = new pthread_cond_t;
+	pthread_cond_init(c, 0);
+	*pcond = c;
+	return MAX_ERR_NONE;
+}
+
+long systhread_cond_free(t_systhread_cond pcond) {
+	pthread_cond_destroy((pthread_cond_t *)pcond);
+	delete (pthread_cond_t *)pcond;
+	return MAX_ERR_NONE;
+}
+
+long systhread_cond_wait(t_systhread_cond pcond, t_systhread_mutex pmutex) {
+	return pthread_cond_wait((pthread_cond_t *)pcond, (pthread_mutex_t *)pmutex);
+}
+
+long systhread_cond_signal(t_systhread_cond pcond) {
+	return pthread_cond_signal((pthread_cond_t *)pcond);
+}
+
+long systhread_cond_broadcast(t_systhread_cond pcond) {
+	return pthread_cond_broadcast((pthread_cond_t *)pcond);
+}
+
+// memory:
+
+char **sysmem_newhandle(long size) {
+	char ** h = (char **)malloc(sizeof(char *));
+	*h = (char *)malloc(size > 0 ? size : 1);
+	return h;
+}
+
+void sysmem_freehandle(char **handle) {
+	if (!handle) return;
+	free(*handle);
+	free(handle);
+}
+
+void *sysmem_newptr(long size) {
+	return malloc(size);
+}
+
+void *sysmem_newptrclear(long size) {
+	return calloc(1, size);
+}
+
+void sysmem_freeptr(void *ptr) {
+	free(ptr);
+}
+
+// files:
+
+void headless_add_search_path(C74_CONST char *dir) {
+	s_paths.push_back(dir);
+}
+
+static bool file_exists(const std::string& path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static short path_id(const std::string& dir) {
+	std::vector<std::string>::iterator it = std::find(s_paths.begin(), s_paths.end(), dir);
+	if (it != s_paths.end()) return (short)(it - s_paths.begin());
+	s_paths.push_back(dir);
+	return (short)(s_paths.size() - 1);
+}
+
+short locatefile_extended(char *name, short *outvol, t_fourcc *outtype, C74_CONST t_fourcc *filetypelist, short numtypes) {
+	std::string n(name);
+	if (outtype) *outtype = numtypes > 0 ? filetypelist[0] : 0;
+
+	// a path: split it into a search path & a file name
+	size_t slash = n.rfind('/');
+	if (slash != std::string::npos) {
+		if (!file_exists(n)) return 1;
+		*outvol = path_id(slash ? n.substr(0, slash) : "/");
+		strcpy(name, n.substr(slash + 1).c_str());
+		return 0;
+	}
+
+	for (size_t i=0; i<s_paths.size(); i++) {
+		if (file_exists(s_paths[i] + "/" + n)) {
+			*outvol = (short)i;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+short path_toabsolutesystempath(short in_path, C74_CONST char *in_filename, char *out_filepath) {
+	char resolved[PATH_MAX];
+	if (in_path < 0 || in_path >= (short)s_paths.size()) return 1;
+	if (!realpath(s_paths[in_path].c_str(), resolved)) return 1;
+
+	std::string path(resolved);
+	if (in_filename && in_filename[0]) path += std::string("/") + in_filename;
+	strncpy(out_filepath, path.c_str(), MAX_PATH_CHARS - 1);
+	out_filepath[MAX_PATH_CHARS - 1] = 0;
+	return 0;
+}
+
+short path_nameconform(C74_CONST char *src, char *dst, long style, long type) {
+	strncpy(dst, src, MAX_PATH_CHARS - 1);
+	dst[MAX_PATH_CHARS - 1] = 0;
+	return 0;
+}
+
+short path_opensysfile(C74_CONST char *name, short path, t_filehandle *ref, short perm) {
+	if (path < 0 || path >= (short)s_paths.size()) return 1;
+	FILE * f = fopen((s_paths[path] + "/" + name).c_str(), (perm & WRITE_PERM) ? "r+b" : "rb");
+	if (!f) return 1;
+	*ref = f;
+	return 0;
+}
+
+t_max_err sysfile_readtextfile(t_filehandle fh, char **htext, long maxlen, long flags) {
+	FILE * f = (FILE *)fh;
+	std::string text;
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+		text.append(buf, n);
+		if (maxlen > 0 && (long)text.size() >= maxlen) {
+			text.resize(maxlen);
+			break;
+		}
+	}
+	*htext = (char *)realloc(*htext, text.size() + 1);
+	memcpy(*htext, text.data(), text.size());
+	(*htext)[text.size()] = 0;
+	return MAX_ERR_NONE;
+}
+
+t_max_err sysfile_close(t_filehandle fh) {
+	return fclose((FILE *)fh) ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+// files are not watched headless:
+void *filewatcher_new(t_object *owner, short path, C74_CONST char *filename) {
+	return live_new(&s_filewatcher_class, sizeof(t_object));
+}
+
+void filewatcher_start(void *x) {}
+void filewatcher_stop(void *x) {}
+
+// MSP:
+
+void dsp_setup(t_pxobject *x, long nsignals) {
+	t_instance * inst = instance(x);
+	if (inst) inst->signal_ins = nsignals;
+}
+
+void dsp_free(t_pxobject *x) {}
+void class_dspinit(t_class *c) {}
+
+static double s_samplerate = 44100.;
+
+double sys_getsr(void) {
+	return s_samplerate;
+}
+
+t_max_err headless_dsp_start(void *x, double samplerate, long vectorsize) {
+	t_class * c = live_class(x);
+	t_instance * inst = instance(x);
+	if (!c || !inst) return MAX_ERR_INVALID_PTR;
+
+	std::map<t_symbol *, t_headless_method>::iterator it = c->methods.find(gensym("dsp64"));
+	if (it == c->methods.end()) {
+		object_error((t_object *)x, "has no dsp64 method");
+		return MAX_ERR_GENERIC;
+	}
+
+	if (!inst->dsp) {
+		inst->dsp = (t_headless_dsp *)live_new(&s_dsp_class, sizeof(t_headless_dsp));
+		inst->dsp->owner = x;
+	}
+	inst->perform = 0;
+	inst->vectorsize = vectorsize;
+	s_samplerate = samplerate;
+
+	std::vector<short> count(inst->signal_ins + inst->signal_outs + 1, 1);
+	((method_dsp64)it->second.fn)(x, inst->dsp, &count[0], samplerate, vectorsize, 0);
+
+	if (!inst->perform) {
+		object_error((t_object *)x, "did not add a perform routine");
+		return MAX_ERR_GENERIC;
+	}
+	return MAX_ERR_NONE;
+}
+
+t_max_err headless_dsp_tick(void *x, double **ins, double **outs) {
+	t_instance * inst = instance(x);
+	if (!inst || !inst->perform) return MAX_ERR_GENERIC;
+	inst->perform((t_object *)x, (t_object *)inst->dsp, ins, inst->signal_ins, outs, inst->signal_outs, inst->vectorsize, inst->perform_flags, inst->perform_userparam);
+	return MAX_ERR_NONE;
+}
+
+long headless_dsp_numins(void *x) {
+	t_instance * inst = instance(x);
+	return inst ? inst->signal_ins : 0;
+}
+
+long headless_dsp_numouts(void *x) {
+	t_instance * inst = instance(x);
+	return inst ? inst->signal_outs : 0;
+}
+
+// Jitter wrappers:
+
+// there is no OpenGL context, so ob3d is inert:
+void *jit_ob3d_setup(void *jit_class, long oboffset, long ob3d_flags) {
+	return jit_class;
+}
+
+t_jit_err jit_ob3d_new(void *x, t_symbol *dest_name) {
+	return JIT_ERR_NONE;
+}
+
+void jit_ob3d_free(void *x) {}
+
+void max_jit_object_free(void *x) {}
+
+long max_jit_attr_args_offset(short ac, t_atom *av) {
+	for (long i=0; i<ac; i++) {
+		if (av[i].a_type == A_SYM && av[i].a_w.w_sym->s_name[0] == '@') return i;
+	}
+	return ac;
+}
+
+t_jit_err jit_atom_arg_getsym(t_symbol **c, long idx, long ac, t_atom *av) {
+	if (idx < ac && av[idx].a_type == A_SYM) {
+		*c = av[idx].a_w.w_sym;
+		return JIT_ERR_NONE;
+	}
+	return JIT_ERR_GENERIC;
+}
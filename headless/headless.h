@@ -0,0 +1,53 @@
+/*
+	Driver-side API of the headless Max/Jitter stand-in.
+
+	The external is linked in and registers its class through ext_main(); the
+	driver then creates an instance, sends it messages on any inlet, services
+	the low-priority queue (qelems) and collects what comes out of its outlets.
+*/
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "ext.h"
+#include "jit.common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// called for every message leaving an outlet; outlets are numbered from the left, as in Max:
+typedef void (*headless_outlet_fn)(void *ctx, void *x, long outlet, t_symbol *s, long argc, t_atom *argv);
+void headless_set_outlet_handler(headless_outlet_fn fn, void *ctx);
+
+// directories searched by locatefile_extended, after the current one:
+void headless_add_search_path(C74_CONST char *dir);
+
+// the name of the last class the external registered:
+C74_CONST char *headless_registered_class(void);
+
+// instantiate a registered class, with creation arguments (including @attrs):
+void *headless_new(C74_CONST char *classname, long argc, t_atom *argv);
+
+// send a message to an inlet; attributes can be set by name, as in Max:
+t_max_err headless_send(void *x, long inlet, t_symbol *s, long argc, t_atom *argv);
+
+// run the qelems that have been set since the last call, returns how many ran:
+long headless_service(void);
+
+// create & register a matrix, returning its name:
+t_symbol *headless_matrix_new(t_jit_matrix_info *info, void **matrix);
+
+// number of errors posted via object_error, error & jit_error_code:
+long headless_error_count(void);
+
+// audio: call the object's dsp64 method, then run its perform routine block by block:
+t_max_err headless_dsp_start(void *x, double samplerate, long vectorsize);
+t_max_err headless_dsp_tick(void *x, double **ins, double **outs);
+long headless_dsp_numins(void *x);
+long headless_dsp_numouts(void *x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEADLESS_H
@@ -0,0 +1,254 @@
+/*
+	Headless stand-in for the parts of the Max API used by the externals in
+	this repository, so that they can be built and profiled without Max.
+
+	The declarations follow the Max 6 SDK; only what the externals call is
+	here. The implementation is in headless/headless.cpp.
+*/
+#ifndef HEADLESS_EXT_H
+#define HEADLESS_EXT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define C74_EXPORT
+#define C74_CONST const
+#define MAX_PATH_CHARS 2048
+
+typedef long t_ptr_int;
+typedef t_ptr_int t_atom_long;
+typedef float t_atom_float;		// as the luajit max.lua cdef assumes
+typedef t_atom_long t_max_err;
+typedef long t_fourcc;
+
+enum {
+	MAX_ERR_NONE = 0,
+	MAX_ERR_GENERIC = -1,
+	MAX_ERR_INVALID_PTR = -2
+};
+
+typedef struct _symbol {
+	char *s_name;
+	struct _object *s_thing;
+} t_symbol;
+
+typedef struct _class t_class;
+
+typedef struct _object {
+	t_class *o_class;
+} t_object;
+
+typedef enum {
+	A_NOTHING = 0,
+	A_LONG,
+	A_FLOAT,
+	A_SYM,
+	A_OBJ,
+	A_DEFLONG,
+	A_DEFFLOAT,
+	A_DEFSYM,
+	A_GIMME,
+	A_CANT,
+	A_SEMI,
+	A_COMMA,
+	A_DOLLAR,
+	A_DOLLSYM,
+	A_GIMMEBACK
+} e_max_atomtypes;
+
+union word {
+	t_atom_long w_long;
+	t_atom_float w_float;
+	t_symbol *w_sym;
+	t_object *w_obj;
+};
+
+typedef struct _atom {
+	short a_type;
+	union word a_w;
+} t_atom;
+
+typedef void *(*method)(void *, ...);
+
+enum { ASSIST_INLET = 1, ASSIST_OUTLET };
+
+#define CLASS_BOX gensym("box")
+#define CLASS_NOBOX gensym("nobox")
+
+#define calcoffset(s,m) ((long)offsetof(s,m))
+
+#ifndef MIN
+#define MIN(a,b) ((a)<(b)?(a):(b))
+#endif
+#ifndef MAX
+#define MAX(a,b) ((a)>(b)?(a):(b))
+#endif
+
+// symbols:
+extern t_symbol *_sym_nothing, *_sym_bang, *_sym_int, *_sym_float, *_sym_list, *_sym_count,
+	*_sym_attr_modified, *_sym_getname, *_sym_none, *_sym_box, *_sym_nobox, *_sym_anything;
+t_symbol *gensym(C74_CONST char *s);
+void common_symbols_init(void);
+
+// console:
+void post(C74_CONST char *fmt, ...);
+void error(C74_CONST char *fmt, ...);
+void object_post(t_object *x, C74_CONST char *s, ...);
+void object_warn(t_object *x, C74_CONST char *s, ...);
+void object_error(t_object *x, C74_CONST char *s, ...);
+
+// classes & objects:
+t_class *class_new(C74_CONST char *name, C74_CONST method mnew, C74_CONST method mfree, long size, C74_CONST method mmenu, short type, ...);
+t_max_err class_addmethod(t_class *c, C74_CONST method m, C74_CONST char *name, ...);
+t_max_err class_register(t_symbol *name_space, t_class *c);
+void *object_alloc(t_class *c);
+t_max_err object_free(void *x);
+void *object_method(void *x, t_symbol *s, ...);
+t_max_err object_method_typed(void *x, t_symbol *s, long ac, t_atom *av, t_atom *rv);
+t_max_err object_notify(void *x, t_symbol *s, void *data);
+
+// attributes (see the CLASS_ATTR_ macros below):
+t_max_err attr_args_process(void *x, short ac, t_atom *av);
+t_atom_long object_attr_getlong(void *x, t_symbol *s);
+t_symbol *object_attr_getsym(void *x, t_symbol *s);
+t_object *object_attr_getobj(void *x, t_symbol *s);
+t_max_err object_attr_setvalueof(void *x, t_symbol *s, long argc, t_atom *argv);
+
+// atoms:
+t_max_err atom_setlong(t_atom *a, t_atom_long b);
+t_max_err atom_setfloat(t_atom *a, double b);
+t_max_err atom_setsym(t_atom *a, t_symbol *b);
+t_max_err atom_setobj(t_atom *a, void *b);
+t_atom_long atom_getlong(C74_CONST t_atom *a);
+t_atom_float atom_getfloat(C74_CONST t_atom *a);
+t_symbol *atom_getsym(C74_CONST t_atom *a);
+void *atom_getobj(C74_CONST t_atom *a);
+long atom_gettype(C74_CONST t_atom *a);
+t_max_err atom_setdouble_array(long ac, t_atom *av, long count, double *vals);
+t_max_err atom_alloc(long *ac, t_atom **av, char *alloc);
+
+// inlets & outlets:
+void *outlet_new(void *x, C74_CONST char *type);
+void *listout(void *x);
+void *bangout(void *x);
+void *intout(void *x);
+void *floatout(void *x);
+void *outlet_bang(void *o);
+void *outlet_int(void *o, t_atom_long n);
+void *outlet_float(void *o, double f);
+void *outlet_list(void *o, t_symbol *s, short ac, t_atom *av);
+void *outlet_anything(void *o, t_symbol *s, short ac, t_atom *av);
+void *proxy_new(void *x, long id, long *stuffloc);
+long proxy_getinlet(t_object *master);
+
+// scheduling:
+void *qelem_new(void *obj, method fn);
+void qelem_set(void *q);
+void qelem_unset(void *q);
+void qelem_free(void *q);
+void *defer(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv);
+void *defer_low(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv);
+double systimer_gettime(void);		// milliseconds
+
+// threads:
+typedef void *t_systhread;
+typedef void *t_systhread_mutex;
+typedef void *t_systhread_cond;
+
+enum { SYSTHREAD_MUTEX_NORMAL = 0, SYSTHREAD_MUTEX_ERRORCHECK = 1, SYSTHREAD_MUTEX_RECURSIVE = 2 };
+
+long systhread_create(method entryproc, void *arg, long stacksize, long priority, long flags, t_systhread *thread);
+long systhread_join(t_systhread thread, unsigned int *retval);
+void systhread_exit(long status);
+short systhread_ismainthread(void);
+long systhread_mutex_new(t_systhread_mutex *pmutex, long flags);
+long systhread_mutex_free(t_systhread_mutex pmutex);
+long systhread_mutex_lock(t_systhread_mutex pmutex);
+long systhread_mutex_unlock(t_systhread_mutex pmutex);
+long systhread_mutex_trylock(t_systhread_mutex pmutex);
+long systhread_cond_new(t_systhread_cond *pcond, long flags);
+long systhread_cond_free(t_systhread_cond pcond);
+long systhread_cond_wait(t_systhread_cond pcond, t_systhread_mutex pmutex);
+long systhread_cond_signal(t_systhread_cond pcond);
+long systhread_cond_broadcast(t_systhread_cond pcond);
+
+// atomics (ext_atomic.h):
+typedef volatile int t_int32_atomic;
+#define ATOMIC_INCREMENT(p) __sync_add_and_fetch((p), 1)
+#define ATOMIC_DECREMENT(p) __sync_sub_and_fetch((p), 1)
+#define ATOMIC_INCREMENT_BARRIER(p) __sync_add_and_fetch((p), 1)
+#define ATOMIC_DECREMENT_BARRIER(p) __sync_sub_and_fetch((p), 1)
+#define ATOMIC_COMPARE_SWAP32(oldvalue, newvalue, atomicptr) __sync_bool_compare_and_swap((atomicptr), (oldvalue), (newvalue))
+
+// memory:
+char **sysmem_newhandle(long size);
+void sysmem_freehandle(char **handle);
+void *sysmem_newptr(long size);
+void *sysmem_newptrclear(long size);
+void sysmem_freeptr(void *ptr);
+
+// files:
+typedef void *t_filehandle;
+
+enum { PATH_STYLE_MAX = 0, PATH_STYLE_NATIVE, PATH_STYLE_SLASH };
+enum { PATH_TYPE_IGNORE = 0, PATH_TYPE_ABSOLUTE, PATH_TYPE_RELATIVE, PATH_TYPE_BOOT };
+enum { READ_PERM = 1, WRITE_PERM = 2 };
+enum { TEXT_LB_NATIVE = 1, TEXT_NULL_TERMINATE = 8 };
+
+short locatefile_extended(char *name, short *outvol, t_fourcc *outtype, C74_CONST t_fourcc *filetypelist, short numtypes);
+short path_toabsolutesystempath(short in_path, C74_CONST char *in_filename, char *out_filepath);
+short path_nameconform(C74_CONST char *src, char *dst, long style, long type);
+short path_opensysfile(C74_CONST char *name, short path, t_filehandle *ref, short perm);
+t_max_err sysfile_readtextfile(t_filehandle fh, char **htext, long maxlen, long flags);
+t_max_err sysfile_close(t_filehandle fh);
+void *filewatcher_new(t_object *owner, short path, C74_CONST char *filename);
+void filewatcher_start(void *x);
+void filewatcher_stop(void *x);
+
+// attribute declaration; the headless version records the member size, so
+// that int members declared with CLASS_ATTR_LONG are written correctly:
+t_max_err headless_class_addattr(t_class *c, C74_CONST char *name, C74_CONST char *type, long offset, long size, long count);
+t_max_err headless_class_attr_accessors(t_class *c, C74_CONST char *name, method getter, method setter);
+t_max_err headless_class_attr_filter(t_class *c, C74_CONST char *name, long hasmin, double min, long hasmax, double max);
+
+#define HEADLESS_MEMBER_SIZE(s,m) ((long)sizeof(((s *)0)->m))
+
+#define CLASS_ATTR_CHAR(c,n,f,s,m) headless_class_addattr((c), (n), "char", calcoffset(s,m), HEADLESS_MEMBER_SIZE(s,m), 1)
+#define CLASS_ATTR_LONG(c,n,f,s,m) headless_class_addattr((c), (n), "long", calcoffset(s,m), HEADLESS_MEMBER_SIZE(s,m), 1)
+#define CLASS_ATTR_FLOAT(c,n,f,s,m) headless_class_addattr((c), (n), "float32", calcoffset(s,m), HEADLESS_MEMBER_SIZE(s,m), 1)
+#define CLASS_ATTR_DOUBLE(c,n,f,s,m) headless_class_addattr((c), (n), "float64", calcoffset(s,m), HEADLESS_MEMBER_SIZE(s,m), 1)
+#define CLASS_ATTR_SYM(c,n,f,s,m) headless_class_addattr((c), (n), "symbol", calcoffset(s,m), HEADLESS_MEMBER_SIZE(s,m), 1)
+#define CLASS_ATTR_OBJ(c,n,f,s,m) headless_class_addattr((c), (n), "object", calcoffset(s,m), HEADLESS_MEMBER_SIZE(s,m), 1)
+#define CLASS_ATTR_CHAR_ARRAY(c,n,f,s,m,z) headless_class_addattr((c), (n), "char", calcoffset(s,m), HEADLESS_MEMBER_SIZE(s,m), (z))
+#define CLASS_ATTR_LONG_ARRAY(c,n,f,s,m,z) headless_class_addattr((c), (n), "long", calcoffset(s,m), HEADLESS_MEMBER_SIZE(s,m), (z))
+#define CLASS_ATTR_FLOAT_ARRAY(c,n,f,s,m,z) headless_class_addattr((c), (n), "float32", calcoffset(s,m), HEADLESS_MEMBER_SIZE(s,m), (z))
+#define CLASS_ATTR_DOUBLE_ARRAY(c,n,f,s,m,z) headless_class_addattr((c), (n), "float64", calcoffset(s,m), HEADLESS_MEMBER_SIZE(s,m), (z))
+
+#define CLASS_ATTR_ACCESSORS(c,n,g,s) headless_class_attr_accessors((c), (n), (method)(g), (method)(s))
+#define CLASS_ATTR_FILTER_MIN(c,n,v) headless_class_attr_filter((c), (n), 1, (v), 0, 0)
+#define CLASS_ATTR_FILTER_MAX(c,n,v) headless_class_attr_filter((c), (n), 0, 0, 1, (v))
+#define CLASS_ATTR_FILTER_CLIP(c,n,a,b) headless_class_attr_filter((c), (n), 1, (a), 1, (b))
+
+// presentation only:
+#define CLASS_ATTR_STYLE(c,n,f,s) ((void)0)
+#define CLASS_ATTR_LABEL(c,n,f,s) ((void)0)
+#define CLASS_ATTR_ENUM(c,n,f,s) ((void)0)
+#define CLASS_ATTR_ENUMINDEX(c,n,f,s) ((void)0)
+#define CLASS_ATTR_INVISIBLE(c,n,f) ((void)0)
+#define CLASS_ATTR_SAVE(c,n,f) ((void)0)
+#define CLASS_ATTR_CATEGORY(c,n,f,s) ((void)0)
+
+// the externals' entry point; the headless Makefile builds them with -Dmain=ext_main
+int ext_main(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEADLESS_EXT_H
@@ -0,0 +1,9 @@
+/*
+	Headless stand-in: the obex declarations all live in ext.h.
+*/
+#ifndef HEADLESS_EXT_OBEX_H
+#define HEADLESS_EXT_OBEX_H
+
+#include "ext.h"
+
+#endif // HEADLESS_EXT_OBEX_H
@@ -0,0 +1,86 @@
+/*
+	Headless stand-in for the Jitter declarations used by the externals.
+
+	jit_matrix and jit_matrix_wrapper objects are real: they own their data,
+	register under a name and answer lock, getinfo, setinfo, setinfo_ex,
+	getdata, clear and frommatrix. Rows are padded to 16 bytes unless
+	JIT_MATRIX_DATA_PACK_TIGHT is set, as in Jitter.
+*/
+#ifndef HEADLESS_JIT_COMMON_H
+#define HEADLESS_JIT_COMMON_H
+
+#include "ext.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JIT_MATRIX_MAX_DIMCOUNT 32
+#define JIT_MATRIX_MAX_PLANECOUNT 32
+
+#define JIT_MATRIX_DATA_HANDLE 0x00000002
+#define JIT_MATRIX_DATA_REFERENCE 0x00000004
+#define JIT_MATRIX_DATA_PACK_TIGHT 0x00000008
+
+typedef t_atom_long t_jit_err;
+
+enum {
+	JIT_ERR_NONE = 0,
+	JIT_ERR_GENERIC = 'EROR',
+	JIT_ERR_INVALID_OBJECT = 'EINO',
+	JIT_ERR_OBJECT_BUSY = 'EOBU',
+	JIT_ERR_OUT_OF_MEM = 'EMEM',
+	JIT_ERR_INVALID_PTR = 'EINP',
+	JIT_ERR_DUPLICATE = 'EDUP',
+	JIT_ERR_OUT_OF_BOUNDS = 'EOOB',
+	JIT_ERR_INVALID_INPUT = 'EINI',
+	JIT_ERR_INVALID_OUTPUT = 'EINU',
+	JIT_ERR_MISMATCH_TYPE = 'EMTY',
+	JIT_ERR_MISMATCH_PLANE = 'EMPL',
+	JIT_ERR_MISMATCH_DIM = 'EMDM',
+	JIT_ERR_MATRIX_UNKNOWN = 'EMUN',
+	JIT_ERR_SUPPRESS_OUTPUT = 'ESUP',
+	JIT_ERR_DATA_UNAVAILABLE = 'EDUN',
+	JIT_ERR_HW_UNAVAILABLE = 'EHUN'
+};
+
+typedef struct _jit_matrix_info {
+	long size;
+	t_symbol *type;
+	long flags;
+	long dimcount;
+	long dim[JIT_MATRIX_MAX_DIMCOUNT];
+	long dimstride[JIT_MATRIX_MAX_DIMCOUNT];
+	long planecount;
+} t_jit_matrix_info;
+
+extern t_symbol *_jit_sym_nothing, *_jit_sym_char, *_jit_sym_long, *_jit_sym_float32, *_jit_sym_float64,
+	*_jit_sym_lock, *_jit_sym_getdata, *_jit_sym_getinfo, *_jit_sym_setinfo, *_jit_sym_setinfo_ex,
+	*_jit_sym_clear, *_jit_sym_frommatrix, *_jit_sym_getmatrix, *_jit_sym_name, *_jit_sym_jit_matrix,
+	*_jit_sym_bang;
+
+void *jit_object_new(t_symbol *classname, ...);
+t_jit_err jit_object_free(void *x);
+void *jit_object_method(void *x, t_symbol *s, ...);
+void *jit_object_register(void *x, t_symbol *s);
+void *jit_object_findregistered(t_symbol *s);
+t_jit_err jit_object_unregister(void *x);
+t_jit_err jit_class_addmethod(void *c, method m, C74_CONST char *name, ...);
+
+t_symbol *jit_symbol_unique(void);
+t_jit_err jit_error_code(void *x, t_jit_err v);
+t_jit_err jit_matrix_info_default(t_jit_matrix_info *info);
+
+t_symbol *jit_attr_getsym(void *x, t_symbol *s);
+t_jit_err jit_attr_setlong(void *x, t_symbol *s, t_atom_long c);
+long jit_attr_getlong_array(void *x, t_symbol *s, long max, t_atom_long *vals);
+
+void max_jit_object_free(void *x);
+long max_jit_attr_args_offset(short ac, t_atom *av);
+t_jit_err jit_atom_arg_getsym(t_symbol **c, long idx, long ac, t_atom *av);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEADLESS_JIT_COMMON_H
@@ -0,0 +1,24 @@
+/*
+	Headless stand-in for the ob3d declarations used by the externals.
+	There is no OpenGL context, so ob3d_draw is never called.
+*/
+#ifndef HEADLESS_JIT_GL_H
+#define HEADLESS_JIT_GL_H
+
+#include "jit.common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JIT_OB3D_NO_MATRIXOUTPUT (1 << 7)
+
+void *jit_ob3d_setup(void *jit_class, long oboffset, long ob3d_flags);
+t_jit_err jit_ob3d_new(void *x, t_symbol *dest_name);
+void jit_ob3d_free(void *x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEADLESS_JIT_GL_H
@@ -0,0 +1,36 @@
+/*
+	Headless stand-in for the MSP declarations used by the externals.
+*/
+#ifndef HEADLESS_Z_DSP_H
+#define HEADLESS_Z_DSP_H
+
+#include "ext.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef double t_double;
+typedef double t_sample;
+
+typedef struct _pxobject {
+	t_object z_ob;
+	long z_in;
+	void *z_proxy;
+	long z_disabled;
+	short z_count;
+	short z_misc;
+} t_pxobject;
+
+typedef void (*t_perfroutine64)(t_object *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+
+void dsp_setup(t_pxobject *x, long nsignals);
+void dsp_free(t_pxobject *x);
+void class_dspinit(t_class *c);
+double sys_getsr(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEADLESS_Z_DSP_H
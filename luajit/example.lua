@@ -5,7 +5,8 @@ local GL = gl
 
 print(string.rep("_", 50))
 
-local t = 0
+-- carried over from the previous version when the script is edited:
+local t = persisted and persisted.t or 0
 local dt = math.pi/40
 
 function draw()
@@ -28,6 +29,10 @@ function bang()
 	t = t + dt
 end
 
+function persist()
+	return { t = t }
+end
+
 function anything(...)
 	print("anything", ...)
 end
@@ -0,0 +1,24 @@
+-- an example dspfile: ring modulation of the left inlet by a sine
+-- (send "param freq 440" to change the frequency)
+
+local sin, pi = math.sin, math.pi
+
+local phase, hz, sr = 0, 220, 44100
+
+function dsp(samplerate, vectorsize)
+	sr = samplerate
+end
+
+function freq(f)
+	hz = f
+end
+
+function perform(ins, outs, n)
+	local input, out = ins[0], outs[0]
+	local inc = 2 * pi * hz / sr
+	for i = 0, n-1 do
+		out[i] = input[i] * sin(phase)
+		phase = phase + inc
+	end
+	phase = phase % (2 * pi)
+end
@@ -15,6 +15,18 @@
 #include "lauxlib.h"
 #include "lualib.h"
 
+#include "ringbuffer.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef WIN_VERSION
+	#include <direct.h>
+	#define luajit_mkdir(path) _mkdir(path)
+#else
+	#define luajit_mkdir(path) mkdir(path, 0755)
+#endif
+
 #ifdef __APPLE__
 	#include "CoreFoundation/CoreFoundation.h"
     #define MY_PLUGIN_BUNDLE_IDENTIFIER "com.cycling74.luajit"
@@ -24,13 +36,61 @@ void *luajit_class;
 
 char bundle_path[MAX_PATH_CHARS];
 
+// a locked matrix as seen from Lua (also used for matrices the script creates):
 typedef struct {
+	void *		matrix;
+	t_symbol *	name;
+	char *		bp;
+	long		inlet;		// -1 for matrices created by the script
+	t_jit_matrix_info info;
+} t_luajit_matrix;
+
+// the audio thread's view of a signal block, filled in by luajit_perform64 (dsp.lua casts it once);
+// the counts are int32_t, as a long would reach Lua as a boxed int64 on LP64 platforms:
+#define LUAJIT_DSP_MAXCHANNELS 32
+typedef struct {
+	double *	ins[LUAJIT_DSP_MAXCHANNELS];
+	double *	outs[LUAJIT_DSP_MAXCHANNELS];
+	int32_t		numins;
+	int32_t		numouts;
+	int32_t		frames;
+	double		samplerate;
+} t_luajit_dsp;
+
+// a message between domains: a call to a global function with numeric arguments,
+// or (if L is set) a new state for the receiving domain to switch to:
+#define LUAJIT_MSG_MAXNAME 32
+#define LUAJIT_MSG_MAXARGS 8
+typedef struct {
+	char		name[LUAJIT_MSG_MAXNAME];
+	lua_State *	L;
+	long		argc;
+	double		argv[LUAJIT_MSG_MAXARGS];
+} t_luajit_msg;
+
+// Scripts run in three domains, each with its own lua_State:
+//  - control: the main script (file), for messages & matrices from the main and
+//    scheduler threads, serialized by control_mutex
+//  - draw: the drawfile script's draw(), on the OpenGL thread
+//  - audio: the dspfile script's perform(), on the audio thread
+// The draw and audio states are created by the main thread and handed over through
+// their domain's inbox; from then on only the owning thread touches them, and only the
+// rings below cross threads. Each domain drains its inbox at a fixed point: the start
+// of a frame (luajit_draw), of a block (luajit_perform64), or for control, a qelem.
+typedef struct {
+	lua_State *	L;				// only touched by the owning thread (and luajit_free)
+	long		failed;			// the script raised an error, skip it until reloaded
+	t_ringbuffer inbox;			// t_luajit_msg, from the control side
+	t_systhread_mutex inbox_mutex;	// serializes the writers of inbox
+	t_ringbuffer outbox;		// t_luajit_msg, to the control state
+	t_ringbuffer retired;		// lua_State *, replaced states for the main thread to close
+	lua_State *	zombie;			// retired while retired was full
+	char		error[256];		// reported by the main thread
+	volatile long haserror;
 	
-	int (*draw)();
-	void (*anything)(t_symbol *s, long argc, t_atom *argv);
-	void (*bang)();
-	
-} t_luajit_handlers;
+	t_symbol *	file;
+	void *		filewatcher;
+} t_luajit_domain;
 
 typedef struct _luajit 
 {
@@ -38,9 +98,11 @@ typedef struct _luajit
 	void *		ob3d;		// OpenGL scene state
 	
 	lua_State * L;
+	t_systhread_mutex control_mutex;
+	void *		control_qelem;	// delivers the other domains' messages, see luajit_control_qfn
 	
 	void *		lua_outlet;
-	t_luajit_handlers lua_handlers;
+	t_luajit_matrix matrix_in;
 	
 	t_symbol * filename;
 	short filepath;
@@ -49,43 +111,119 @@ typedef struct _luajit
 	
 	char system_filename_conformed[MAX_PATH_CHARS];
 	
+	t_luajit_domain draw;	// unused (draw() runs in L) unless drawfile is set
+	t_luajit_domain audio;	// without a dspfile, the signal output is in1 + in2
+	t_luajit_dsp dsp;
+	long		dspgc;
+	
+	long		bccache;
+	
+	// collector scheduling for the control & draw states, see luajit_gc_idle:
+	double		gcbudget;		// microseconds of collection after each frame (0: Lua's own schedule only)
+	long		gcpause;
+	long		gcstepmul;
+	long		gcreport;
+	
+	// replaced states are closed on this thread, as closing a large heap takes a while:
+	t_systhread	closer;
+	t_systhread_mutex closer_mutex;
+	t_systhread_cond closer_cond;
+	t_ringbuffer closer_queue;	// lua_State *, from the main thread
+	int			closer_quit;
+	
 } t_luajit;
 
-t_max_err luajit_handlers_set(t_luajit *x, t_object *attr, long argc, t_atom *argv) {
-	object_error((t_object *)x, "attribute is read only");
+void *luajit_closer(t_luajit *x);
+void luajit_gc_setparams(t_luajit *x, lua_State *L);
+
+t_symbol *ps_draw, *ps_gc;
+
+// message dispatch: Max messages call the Lua global of the same name, which is
+// looked up on every call so that scripts can redefine handlers at any time. The
+// Lua strings for message names are cached in the registry, keyed by t_symbol *,
+// so dispatch doesn't allocate once a message has been seen.
+
+void luajit_pushsymbol(lua_State *L, t_symbol *s) {
+	lua_getfield(L, LUA_REGISTRYINDEX, "luajit.symbols");
+	lua_pushlightuserdata(L, s);
+	lua_rawget(L, -2);
+	if (lua_isnil(L, -1)) {
+		lua_pop(L, 1);
+		lua_pushstring(L, s->s_name);
+		lua_pushlightuserdata(L, s);
+		lua_pushvalue(L, -2);
+		lua_rawset(L, -4);
+	}
+	lua_remove(L, -2);
+}
+
+void luajit_pushatoms(lua_State *L, long argc, t_atom *argv) {
+	long i;
+	for (i=0; i<argc; i++) {
+		switch (atom_gettype(argv+i)) {
+			case A_LONG: lua_pushnumber(L, (lua_Number)atom_getlong(argv+i)); break;
+			case A_FLOAT: lua_pushnumber(L, atom_getfloat(argv+i)); break;
+			case A_SYM: luajit_pushsymbol(L, atom_getsym(argv+i)); break;
+			case A_OBJ: lua_pushlightuserdata(L, atom_getobj(argv+i)); break;
+			default: lua_pushnil(L); break;
+		}
+	}
+}
+
+// push the global function named s, returns 0 (and pushes nothing) if there isn't one:
+int luajit_pushhandler(lua_State *L, t_symbol *s) {
+	luajit_pushsymbol(L, s);
+	lua_rawget(L, LUA_GLOBALSINDEX);
+	if (lua_isfunction(L, -1)) return 1;
+	lua_pop(L, 1);
 	return 0;
 }
 
-t_max_err luajit_handlers_get(t_luajit *x, t_object *attr, long *argc, t_atom **argv) {
-	char alloc;
-	atom_alloc(argc, argv, &alloc);     // allocate return atom
-	atom_setobj(*argv, &x->lua_handlers);
+// call the function below the nargs arguments on the stack, with debug.traceback
+// at index errfunc; returns non-zero on error:
+int luajit_pcall(t_luajit *x, lua_State *L, int nargs, int errfunc) {
+	if (lua_pcall(L, nargs, 0, errfunc)) {
+		object_error((t_object *)x, "%s", lua_tostring(L, -1));
+		return 1;
+	}
 	return 0;
 }
 
-t_jit_err luajit_draw(t_luajit *x) {
-	t_jit_err result = JIT_ERR_NONE;
-	
-	/*
-	int debug_traceback;
-	
-	lua_getfield(x->L, LUA_REGISTRYINDEX, "debug.traceback");
-	debug_traceback = lua_gettop(x->L);	
-	lua_getglobal(x->L, "draw");
-	if (lua_isfunction(x->L, -1)) {
-		if (lua_pcall(x->L, 0, 0, debug_traceback)) {
-			object_error((t_object *)x, lua_tostring(x->L, -1));
-		}
+// as luajit_pcall, but leaves the function's result on the stack (nil if there
+// is none) unless there is an error:
+int luajit_pcall_result(t_luajit *x, lua_State *L, int nargs, int errfunc) {
+	if (lua_pcall(L, nargs, 1, errfunc)) {
+		object_error((t_object *)x, "%s", lua_tostring(L, -1));
+		return 1;
 	}
-	// clear returns & debug.traceback:
-	lua_settop(x->L, 0);
-	*/
+	return 0;
+}
+
+// call the handler for message s (or anything(s, ...) if there isn't one);
+// returns non-zero on error:
+int luajit_dispatch(t_luajit *x, t_symbol *s, long argc, t_atom *argv) {
+	lua_State *L;
+	int top, err = 0;
 	
-	// now try calling the draw handler:
-	if (x->lua_handlers.draw) {
-		result = x->lua_handlers.draw() * JIT_ERR_GENERIC;
+	systhread_mutex_lock(x->control_mutex);
+	L = x->L;
+	if (!L) {
+		systhread_mutex_unlock(x->control_mutex);
+		return 0;
 	}
-	return result;
+	top = lua_gettop(L);
+	lua_getfield(L, LUA_REGISTRYINDEX, "debug.traceback");
+	if (luajit_pushhandler(L, s)) {
+		luajit_pushatoms(L, argc, argv);
+		err = luajit_pcall(x, L, argc, top + 1);
+	} else if (luajit_pushhandler(L, _sym_anything)) {
+		luajit_pushsymbol(L, s);
+		luajit_pushatoms(L, argc, argv);
+		err = luajit_pcall(x, L, argc + 1, top + 1);
+	}
+	lua_settop(L, top);
+	systhread_mutex_unlock(x->control_mutex);
+	return err;
 }
 
 t_jit_err luajit_dest_closing(t_luajit *x) {
@@ -95,8 +233,178 @@ t_jit_err luajit_dest_changed(t_luajit *x) {
 	return JIT_ERR_NONE;
 }
 
-lua_State * luajit_newstate(t_luajit *x) {
+// BYTECODE CACHE: scripts & the modules they require are compiled once, then loaded
+// from bytecode while the source's modification time & size stay the same. The cache
+// is in the temp folder, one file per source path: a header, the path, the bytecode.
+
+typedef struct {
+	char		magic[32];		// see luajit_bcmagic
+	long long	mtime;
+	long long	size;
+	unsigned long pathlen;
+} t_luajit_bcheader;
+
+typedef struct {
+	char *		data;
+	size_t		size;
+	size_t		capacity;
+} t_luajit_buffer;
+
+// bytecode is only good for the same LuaJIT build & pointer size:
+void luajit_bcmagic(char *magic) {
+	memset(magic, 0, 32);
+	snprintf(magic, 31, "bc%d %s", (int)sizeof(void *), LUAJIT_VERSION);
+}
+
+void luajit_bcpath(const char *path, char *cachepath) {
+	const char *tmp = getenv("TMPDIR");
+	unsigned long long hash = 14695981039346656037ULL;	// FNV-1a
+	const char *p;
+	
+	if (!tmp) tmp = getenv("TEMP");
+	if (!tmp) tmp = "/tmp";
+	for (p = path; *p; p++) hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+	snprintf(cachepath, MAX_PATH_CHARS, "%s/luajit-bccache", tmp);
+	luajit_mkdir(cachepath);	// fails harmlessly if it exists
+	snprintf(cachepath, MAX_PATH_CHARS, "%s/luajit-bccache/%016llx.bc", tmp, hash);
+}
+
+int luajit_bcwriter(lua_State *L, const void *p, size_t size, void *ud) {
+	t_luajit_buffer *b = (t_luajit_buffer *)ud;
+	if (b->size + size > b->capacity) {
+		char *data;
+		size_t capacity = b->capacity ? b->capacity * 2 : 65536;
+		while (capacity < b->size + size) capacity *= 2;
+		data = (char *)realloc(b->data, capacity);
+		if (!data) return 1;
+		b->data = data;
+		b->capacity = capacity;
+	}
+	memcpy(b->data + b->size, p, size);
+	b->size += size;
+	return 0;
+}
+
+// load the cached bytecode for path, if it is still valid; returns non-zero if not
+// (and pushes nothing):
+int luajit_bcload(lua_State *L, const char *path, const char *cachepath, const char *chunkname, struct stat *st) {
+	t_luajit_bcheader header;
+	char magic[32];
+	size_t pathlen = strlen(path);
+	long size;
+	char *data;
+	int err = 1;
+	FILE *f = fopen(cachepath, "rb");
+	
+	if (!f) return 1;
+	luajit_bcmagic(magic);
+	if (fread(&header, sizeof(header), 1, f) == 1 && !memcmp(header.magic, magic, sizeof(magic))
+		&& header.mtime == (long long)st->st_mtime && header.size == (long long)st->st_size && header.pathlen == pathlen
+		&& !fseek(f, 0, SEEK_END) && (size = ftell(f) - (long)(sizeof(header) + pathlen)) > 0
+		&& !fseek(f, sizeof(header), SEEK_SET)) {
+		data = (char *)malloc(pathlen + size);
+		if (data && fread(data, 1, pathlen + size, f) == pathlen + size && !memcmp(data, path, pathlen)) {
+			err = luaL_loadbuffer(L, data + pathlen, size, chunkname);
+			if (err) lua_pop(L, 1);
+		}
+		free(data);
+	}
+	fclose(f);
+	return err;
+}
+
+// save the function on top of the stack as the cached bytecode for path:
+void luajit_bcsave(lua_State *L, const char *path, const char *cachepath, struct stat *st) {
+	t_luajit_bcheader header;
+	t_luajit_buffer b = { 0, 0, 0 };
+	char tmppath[MAX_PATH_CHARS + 4];
+	FILE *f;
+	int ok;
+	
+	if (lua_dump(L, luajit_bcwriter, &b) || !b.size) {
+		free(b.data);
+		return;
+	}
+	luajit_bcmagic(header.magic);
+	header.mtime = st->st_mtime;
+	header.size = st->st_size;
+	header.pathlen = strlen(path);
+	
+	// written aside, then moved into place, so that a reader never sees half a file:
+	snprintf(tmppath, sizeof(tmppath), "%s.tmp", cachepath);
+	f = fopen(tmppath, "wb");
+	if (f) {
+		ok = fwrite(&header, sizeof(header), 1, f) == 1
+			&& fwrite(path, 1, header.pathlen, f) == header.pathlen
+			&& fwrite(b.data, 1, b.size, f) == b.size;
+		ok = !fclose(f) && ok;
+		remove(cachepath);
+		if (!ok || rename(tmppath, cachepath)) remove(tmppath);
+	}
+	free(b.data);
+}
+
+// luaL_loadfile, through the cache: pushes the chunk, or an error message and
+// returns non-zero:
+int luajit_loadfile(t_luajit *x, lua_State *L, const char *path) {
+	struct stat st;
+	char cachepath[MAX_PATH_CHARS];
+	char chunkname[MAX_PATH_CHARS + 1];
+	
+	if (!x->bccache || stat(path, &st)) return luaL_loadfile(L, path);
+	snprintf(chunkname, sizeof(chunkname), "@%s", path);	// as luaL_loadfile names it
+	luajit_bcpath(path, cachepath);
+	if (luajit_bcload(L, path, cachepath, chunkname, &st) == 0) return 0;
+	
+	if (luaL_loadfile(L, path)) return 1;
+	luajit_bcsave(L, path, cachepath, &st);
+	return 0;
+}
+
+// a package.loaders entry ahead of Lua's file loader, which does the same search of
+// package.path but loads through the cache:
+int luajit_loader(lua_State *L) {
+	t_luajit *x = (t_luajit *)lua_touserdata(L, lua_upvalueindex(1));
+	const char *name, *p, *end;
+	char filename[MAX_PATH_CHARS];
+	size_t i, len, namelen;
+	FILE *f;
+	
+	if (!x->bccache) return 0;
+	name = luaL_gsub(L, luaL_checkstring(L, 1), ".", LUA_DIRSEP);
+	namelen = strlen(name);
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "path");
+	p = lua_tostring(L, -1);
+	while (p && *p) {
+		end = strchr(p, *LUA_PATHSEP);
+		if (!end) end = p + strlen(p);
+		
+		// the template, with ? replaced by the name:
+		for (len = 0; p < end && len < MAX_PATH_CHARS - 1; p++) {
+			if (*p == *LUA_PATH_MARK) {
+				for (i = 0; i < namelen && len < MAX_PATH_CHARS - 1; i++) filename[len++] = name[i];
+			} else {
+				filename[len++] = *p;
+			}
+		}
+		filename[len] = 0;
+		if (len && (f = fopen(filename, "r"))) {
+			fclose(f);
+			if (luajit_loadfile(x, L, filename)) {
+				return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", lua_tostring(L, 1), filename, lua_tostring(L, -1));
+			}
+			return 1;
+		}
+		p = *end ? end + 1 : end;
+	}
+	return 0;	// not found, Lua's loaders will say so
+}
+
+// a new state, with the module paths set up for scripts in path:
+lua_State * luajit_state_new(t_luajit *x, short path) {
 	lua_State * L;
+	int i;
 	char local_path[MAX_PATH_CHARS];
 	
 	L = lua_open();
@@ -105,12 +413,33 @@ lua_State * luajit_newstate(t_luajit *x) {
 	} else {
 		// initialize L:
 		luaL_openlibs(L);
+		luajit_gc_setparams(x, L);
+		
+		// modules load through the bytecode cache, see luajit_loader:
+		lua_getglobal(L, "package");
+		lua_getfield(L, -1, "loaders");
+		for (i = (int)lua_objlen(L, -1); i >= 2; i--) {
+			lua_rawgeti(L, -1, i);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_pushlightuserdata(L, x);
+		lua_pushcclosure(L, luajit_loader, 1);
+		lua_rawseti(L, -2, 2);
+		lua_pop(L, 2);
 		
 		// cache debug.traceback:
 		lua_getglobal(L, "debug");
 		lua_getfield(L, -1, "traceback");
 		lua_setfield(L, LUA_REGISTRYINDEX, "debug.traceback");
 		
+		// message names, see luajit_dispatch:
+		lua_newtable(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, "luajit.symbols");
+		
+		// the incoming matrix view, see luajit_jit_matrix (max.lua replaces this with a typed pointer):
+		lua_pushlightuserdata(L, &x->matrix_in);
+		lua_setfield(L, LUA_REGISTRYINDEX, "luajit.matrix_in");
+		
 		// add the local path to the package path:
 			
 		#ifdef __APPLE__
@@ -124,7 +453,7 @@ lua_State * luajit_newstate(t_luajit *x) {
 			}
 		#endif
 		
-		if (path_toabsolutesystempath(x->filepath, "", local_path)) {
+		if (path_toabsolutesystempath(path, "", local_path)) {
 			object_warn((t_object *)x, "problem resolving package path");
 		} else {	
 			
@@ -149,73 +478,349 @@ lua_State * luajit_newstate(t_luajit *x) {
 		
 		// leave it nice:
 		lua_settop(L, 0);
-		
-		// swap states:
-		if (x->L) lua_close(x->L);
-		x->L = L;
 	}
 	return L;
 }
 
-void luajit_dostring(t_luajit *x, C74_CONST char * text) {
-	if (luaL_dostring(x->L, text)) {
-		object_error((t_object *)x, lua_tostring(x->L, -1));
+// closer thread: close the states it is given until asked to quit
+void *luajit_closer(t_luajit *x) {
+	lua_State *L;
+	
+	systhread_mutex_lock(x->closer_mutex);
+	while (1) {
+		if (ringbuffer_read(&x->closer_queue, &L)) {
+			systhread_mutex_unlock(x->closer_mutex);
+			lua_close(L);
+			systhread_mutex_lock(x->closer_mutex);
+		} else if (x->closer_quit) {
+			break;
+		} else {
+			systhread_cond_wait(x->closer_cond, x->closer_mutex);
+		}
 	}
+	systhread_mutex_unlock(x->closer_mutex);
+	systhread_exit(0);
+	return 0;
 }
 
-void luajit_doread(t_luajit *x) {
+// main thread: close a state that nothing uses any more, off the main thread:
+void luajit_close_later(t_luajit *x, lua_State *L) {
+	int queued;
+	
+	// the Jitter objects the scripts own must be freed here on the main thread, not by
+	// finalizers on the closer thread while a reloaded script re-creates them (see max.lua):
+	lua_getfield(L, LUA_REGISTRYINDEX, "luajit.release");
+	if (lua_isfunction(L, -1)) {
+		luajit_pcall(x, L, 0, 0);
+	}
+	lua_settop(L, 0);
+	
+	systhread_mutex_lock(x->closer_mutex);
+	queued = ringbuffer_write(&x->closer_queue, &L);
+	if (queued) {
+		if (!x->closer) systhread_create((method)luajit_closer, x, 0, 0, 0, &x->closer);
+		systhread_cond_signal(x->closer_cond);
+	}
+	systhread_mutex_unlock(x->closer_mutex);
+	if (!queued) lua_close(L);
+}
+
+// copy the value at index idx of the state from to the top of the state to: nil,
+// booleans, numbers, strings, light userdata and tables of these (functions, cdata
+// and userdata become nil); the table at index visited of to maps the tables already
+// copied, so that shared & cyclic references survive:
+void luajit_copyvalue(lua_State *from, int idx, lua_State *to, int visited, int depth) {
+	switch (lua_type(from, idx)) {
+		case LUA_TBOOLEAN: lua_pushboolean(to, lua_toboolean(from, idx)); break;
+		case LUA_TNUMBER: lua_pushnumber(to, lua_tonumber(from, idx)); break;
+		case LUA_TSTRING: {
+			size_t len;
+			const char *str = lua_tolstring(from, idx, &len);
+			lua_pushlstring(to, str, len);
+		} break;
+		case LUA_TLIGHTUSERDATA: lua_pushlightuserdata(to, lua_touserdata(from, idx)); break;
+		case LUA_TTABLE: {
+			lua_pushlightuserdata(to, (void *)lua_topointer(from, idx));
+			lua_rawget(to, visited);
+			if (!lua_isnil(to, -1) || depth > 100) break;
+			lua_pop(to, 1);
+			lua_newtable(to);
+			lua_pushlightuserdata(to, (void *)lua_topointer(from, idx));
+			lua_pushvalue(to, -2);
+			lua_rawset(to, visited);
+			
+			if (idx < 0) idx = lua_gettop(from) + idx + 1;
+			lua_checkstack(from, 3);
+			lua_checkstack(to, 4);
+			lua_pushnil(from);
+			while (lua_next(from, idx)) {
+				luajit_copyvalue(from, -2, to, visited, depth + 1);
+				luajit_copyvalue(from, -1, to, visited, depth + 1);
+				if (lua_isnil(to, -2) || lua_isnil(to, -1)) {
+					lua_pop(to, 2);		// a key or value that can't be copied
+				} else {
+					lua_rawset(to, -3);
+				}
+				lua_pop(from, 1);
+			}
+		} break;
+		default: lua_pushnil(to); break;
+	}
+}
+
+// hot reload: the table the old script's persist() returns becomes the new script's
+// global persisted, before it runs:
+void luajit_persist(t_luajit *x, lua_State *from, lua_State *to) {
+	int top = lua_gettop(from);
+	
+	lua_getfield(from, LUA_REGISTRYINDEX, "debug.traceback");
+	lua_getglobal(from, "persist");
+	if (lua_isfunction(from, -1)) {
+		if (luajit_pcall_result(x, from, 0, top + 1) == 0) {
+			lua_newtable(to);
+			luajit_copyvalue(from, -1, to, lua_gettop(to), 0);
+			lua_setglobal(to, "persisted");
+			lua_pop(to, 1);
+		}
+	}
+	lua_settop(from, top);
+}
+
+lua_State * luajit_newstate(t_luajit *x) {
+	lua_State * L = luajit_state_new(x, x->filepath);
+	if (L) {
+		// swap states:
+		if (x->L) {
+			luajit_persist(x, x->L, L);
+			luajit_close_later(x, x->L);
+		}
+		x->L = L;
+	}
+	return L;
+}
+
+// find a script in the search path, and its native path; returns non-zero if it isn't found:
+int luajit_locate(t_luajit *x, t_symbol *name, short *outpath, char *native) {
 	char filename[MAX_PATH_CHARS];
 	char system_filename[MAX_PATH_CHARS];
 	
-	short path;
-	t_max_err err;
 	t_fourcc filetype = 'TEXT';
 	t_fourcc outtype;
 	
-	t_filehandle fh;
-	char **texthandle;
+	strcpy(filename, name->s_name);    // must copy symbol before calling locatefile_extended
+	if (locatefile_extended(filename, outpath, &outtype, &filetype, 1)) { // non-zero: not found
+		object_error((t_object *)x, "%s: not found", name->s_name);
+		return 1;
+	}
+	if (path_toabsolutesystempath(*outpath, filename, system_filename)) {
+		object_error((t_object *)x, "%s: could not resolve path", name->s_name);
+		return 1;
+	}
+	path_nameconform(system_filename, native, PATH_STYLE_NATIVE, PATH_TYPE_BOOT);
+	return 0;
+}
+
+void luajit_doread(t_luajit *x) {
+	short path;
+	lua_State *L;
+	
+	if (luajit_locate(x, x->filename, &path, x->system_filename_conformed)) return;
+	
+	// store new path:
+	x->filepath = path;
 	
-	strcpy(filename, x->filename->s_name);    // must copy symbol before calling locatefile_extended
-	if (locatefile_extended(filename, &path, &outtype, &filetype, 1)) { // non-zero: not found
-		object_error((t_object *)x, "%s: not found", x->filename->s_name);
+	systhread_mutex_lock(x->control_mutex);
+	L = luajit_newstate(x);
+	if (L) {
+	
+		// start filewatching:
+		if (x->filewatcher) {
+			filewatcher_stop(x->filewatcher);
+			object_free(x->filewatcher);
+		}
+		x->filewatcher = filewatcher_new((t_object *)x, x->filepath, x->filename->s_name);
+		filewatcher_start(x->filewatcher);	
+	
+		// now run it:
+		lua_getfield(L, LUA_REGISTRYINDEX, "debug.traceback");
+		if (luajit_loadfile(x, L, x->system_filename_conformed) || lua_pcall(L, 0, 0, 1)) {
+			object_error((t_object *)x, "%s", lua_tostring(L, -1));
+		}
+		lua_settop(L, 0);
+	}
+	systhread_mutex_unlock(x->control_mutex);
+}
+
+// THE OTHER DOMAINS, from the control side (main & scheduler threads)
+
+// queue a message for a domain; returns 0 if its inbox is full:
+int luajit_domain_send(t_luajit_domain *d, t_luajit_msg *msg) {
+	int ok;
+	systhread_mutex_lock(d->inbox_mutex);
+	ok = ringbuffer_write(&d->inbox, msg);
+	systhread_mutex_unlock(d->inbox_mutex);
+	return ok;
+}
+
+// <name> <numbers...> from Max, to a domain:
+void luajit_domain_message(t_luajit *x, t_luajit_domain *d, t_symbol *s, long argc, t_atom *argv) {
+	t_luajit_msg msg;
+	long i;
+	
+	if (d->file == _sym_none) {
+		object_error((t_object *)x, "%s: no %s", s->s_name, d == &x->audio ? "dspfile" : "drawfile");
+		return;
+	}
+	if (argc < 1 || atom_gettype(argv) != A_SYM || strlen(atom_getsym(argv)->s_name) >= LUAJIT_MSG_MAXNAME) {
+		object_error((t_object *)x, "%s: expects a name and up to %d numbers", s->s_name, LUAJIT_MSG_MAXARGS);
 		return;
 	}
+	strcpy(msg.name, atom_getsym(argv)->s_name);
+	msg.L = 0;
+	msg.argc = MIN(argc - 1, LUAJIT_MSG_MAXARGS);
+	for (i=0; i<msg.argc; i++) {
+		msg.argv[i] = atom_getfloat(argv + 1 + i);
+	}
+	if (!luajit_domain_send(d, &msg)) {
+		object_warn((t_object *)x, "%s %s: queue is full, dropped", s->s_name, msg.name);
+	}
+}
+
+// param <name> <numbers...>: call name(...) in the dspfile script, before the next block
+void luajit_param(t_luajit *x, t_symbol *s, long argc, t_atom *argv) {
+	luajit_domain_message(x, &x->audio, s, argc, argv);
+}
+
+// todraw <name> <numbers...>: call name(...) in the drawfile script, before the next frame
+void luajit_todraw(t_luajit *x, t_symbol *s, long argc, t_atom *argv) {
+	luajit_domain_message(x, &x->draw, s, argc, argv);
+}
+
+// main thread: close the states a domain is done with, report its errors, and pass
+// its messages on to the control state:
+void luajit_domain_collect(t_luajit *x, t_luajit_domain *d) {
+	lua_State *L;
+	t_luajit_msg msg;
+	t_atom argv[LUAJIT_MSG_MAXARGS];
+	long i;
 	
-	err = path_toabsolutesystempath	(path, filename, system_filename);	
-	path_nameconform(system_filename, x->system_filename_conformed, PATH_STYLE_NATIVE, PATH_TYPE_BOOT);
+	while (ringbuffer_read(&d->retired, &L)) {
+		luajit_close_later(x, L);
+	}
+	if (d->haserror) {
+		object_error((t_object *)x, "%s", d->error);
+		d->haserror = 0;
+	}
+	while (ringbuffer_read(&d->outbox, &msg)) {
+		for (i=0; i<msg.argc; i++) {
+			atom_setfloat(argv + i, msg.argv[i]);
+		}
+		luajit_dispatch(x, gensym(msg.name), msg.argc, argv);
+	}
+}
+
+// the control domain's hand-off point:
+void luajit_control_qfn(t_luajit *x) {
+	luajit_domain_collect(x, &x->draw);
+	luajit_domain_collect(x, &x->audio);
+}
+
+// tocontrol(name, numbers...), in the draw and audio states: call name(...) in the
+// control state, from the main thread; returns false if the queue is full
+int luajit_tocontrol(lua_State *L) {
+	t_luajit *x = (t_luajit *)lua_touserdata(L, lua_upvalueindex(1));
+	t_luajit_domain *d = (t_luajit_domain *)lua_touserdata(L, lua_upvalueindex(2));
+	t_luajit_msg msg;
+	size_t len;
+	const char *name = luaL_checklstring(L, 1, &len);
+	long i;
 	
-	// we have a file:
-	if (path_opensysfile(filename, path, &fh, READ_PERM)) {
-		object_error((t_object *)x, "error opening %s", filename);
-		return;
+	luaL_argcheck(L, len < LUAJIT_MSG_MAXNAME, 1, "name too long");
+	memcpy(msg.name, name, len + 1);
+	msg.L = 0;
+	msg.argc = MIN(lua_gettop(L) - 1, LUAJIT_MSG_MAXARGS);
+	for (i=0; i<msg.argc; i++) {
+		msg.argv[i] = luaL_checknumber(L, i + 2);
 	}
+	lua_pushboolean(L, ringbuffer_write(&d->outbox, &msg));
+	qelem_set(x->control_qelem);
+	return 1;
+}
+
+// load a domain's script into a new state, and hand it over:
+void luajit_domain_doread(t_luajit *x, t_luajit_domain *d) {
+	short path;
+	char native[MAX_PATH_CHARS];
+	lua_State *L;
+	t_luajit_msg msg;
 	
-	// store new path:
-	x->filepath = path;
-		
-	// allocate some empty memory to receive text
-	texthandle = sysmem_newhandle(0);
-	if (sysfile_readtextfile(fh, texthandle, 0, TEXT_NULL_TERMINATE)) {
-		object_error((t_object *)x, "failed to read %s", x->filename->s_name);
-	} else {
+	if (d->file == _sym_none) return;
+	if (luajit_locate(x, d->file, &path, native)) return;
 	
-		// now run it:
-		if (luajit_newstate(x)) {
+	L = luajit_state_new(x, path);
+	if (L) {
+		if (d->filewatcher) {
+			filewatcher_stop(d->filewatcher);
+			object_free(d->filewatcher);
+		}
+		d->filewatcher = filewatcher_new((t_object *)x, path, d->file->s_name);
+		filewatcher_start(d->filewatcher);
 		
-			// start filewatching:
-			if (x->filewatcher) {
-				filewatcher_stop(x->filewatcher);
-				object_free(x->filewatcher);
-			}
-			x->filewatcher = filewatcher_new((t_object *)x, x->filepath, x->filename->s_name);
-			filewatcher_start(x->filewatcher);	
+		lua_pushlightuserdata(L, x);
+		lua_pushlightuserdata(L, d);
+		lua_pushcclosure(L, luajit_tocontrol, 2);
+		lua_setglobal(L, "tocontrol");
 		
-			luajit_dostring(x, *texthandle);
+		lua_getfield(L, LUA_REGISTRYINDEX, "debug.traceback");
+		if (d == &x->audio) {
+			lua_pushlightuserdata(L, &x->dsp);
+			lua_setfield(L, LUA_REGISTRYINDEX, "luajit.dsp");
+			if (luaL_loadstring(L, "require 'dsp'") || lua_pcall(L, 0, 0, 1)) {
+				object_error((t_object *)x, "%s", lua_tostring(L, -1));
+				lua_close(L);
+				L = 0;
+			}
+		}
+		if (L && (luajit_loadfile(x, L, native) || lua_pcall(L, 0, 0, 1))) {
+			object_error((t_object *)x, "%s", lua_tostring(L, -1));
+			lua_close(L);
+			L = 0;
+		}
+		if (L) {
+			lua_settop(L, 0);
+			// the audio collector only runs between blocks, see luajit_perform64:
+			if (d == &x->audio) lua_gc(L, LUA_GCSTOP, 0);
+			
+			memset(&msg, 0, sizeof(msg));
+			msg.L = L;
+			if (!luajit_domain_send(d, &msg)) {
+				object_error((t_object *)x, "%s: queue is full, is %s on?", d->file->s_name, d == &x->audio ? "audio" : "rendering");
+				lua_close(L);
+			}
 		}
-		
 	}
-	sysfile_close(fh);
-	sysmem_freehandle(texthandle);
+}
+
+void luajit_draw_doread(t_luajit *x) {
+	luajit_domain_doread(x, &x->draw);
+}
+
+void luajit_dsp_doread(t_luajit *x) {
+	luajit_domain_doread(x, &x->audio);
+}
+
+t_max_err luajit_drawfile_set(t_luajit *x, t_object *attr, long argc, t_atom *argv)
+{
+	x->draw.file = atom_getsym(argv); // A_SYM
+	defer(x, (method)luajit_draw_doread, 0, 0, 0);
+	return 0;
+}
+
+t_max_err luajit_dspfile_set(t_luajit *x, t_object *attr, long argc, t_atom *argv)
+{
+	x->audio.file = atom_getsym(argv); // A_SYM
+	defer(x, (method)luajit_dsp_doread, 0, 0, 0);
+	return 0;
 }
 
 t_max_err luajit_filename_set(t_luajit *x, t_object *attr, long argc, t_atom *argv)
@@ -228,12 +833,20 @@ t_max_err luajit_filename_set(t_luajit *x, t_object *attr, long argc, t_atom *ar
 void luajit_filechanged(t_luajit *x, char *filename, short path) {
 	object_post((t_object *)x, "file changed, reloading: %s", filename);
 	if (x->autowatch) {
-		defer(x, (method)luajit_doread, 0, 0, 0);
+		if (x->audio.file != _sym_none && !strcmp(filename, x->audio.file->s_name)) {
+			defer(x, (method)luajit_dsp_doread, 0, 0, 0);
+		} else if (x->draw.file != _sym_none && !strcmp(filename, x->draw.file->s_name)) {
+			defer(x, (method)luajit_draw_doread, 0, 0, 0);
+		} else {
+			defer(x, (method)luajit_doread, 0, 0, 0);
+		}
 	}
 }
 
 void luajit_reload(t_luajit *x) {
 	defer(x, (method)luajit_doread, 0, 0, 0);
+	defer(x, (method)luajit_draw_doread, 0, 0, 0);
+	defer(x, (method)luajit_dsp_doread, 0, 0, 0);
 }
 
 // object_notify
@@ -251,7 +864,7 @@ t_max_err luajit_notify(t_luajit *x, t_symbol *s, t_symbol *msg, void *sender, v
 }
 
 void luajit_bang(t_luajit * x) {
-	x->lua_handlers.bang();
+	luajit_dispatch(x, _sym_bang, 0, 0);
 }
 
 void luajit_anything(t_luajit *x, t_symbol *s, long argc, t_atom *argv)
@@ -259,52 +872,318 @@ void luajit_anything(t_luajit *x, t_symbol *s, long argc, t_atom *argv)
 	//object_post( (t_object*)x, "This method was invoked by sending the '%s' message to this object.", s->s_name);
 	// argc and argv are the arguments, as described in above.
 	
-	x->lua_handlers.anything(s, argc, argv);
+	luajit_dispatch(x, s, argc, argv);
 }
 
 void luajit_jit_matrix(t_luajit *x, t_symbol *s, long argc, t_atom *argv)
 {
-	post("got matrix");
+	t_luajit_matrix *m = &x->matrix_in;
+	lua_State *L;
+	long savelock;
+	int top;
 	
-	/*
+	systhread_mutex_lock(x->control_mutex);
+	L = x->L;
+	if (!L) {
+		systhread_mutex_unlock(x->control_mutex);
+		return;
+	}
+	top = lua_gettop(L);
+	lua_getfield(L, LUA_REGISTRYINDEX, "debug.traceback");
+	if (luajit_pushhandler(L, _jit_sym_jit_matrix)) {
+		m->name = argc ? atom_getsym(argv) : _jit_sym_nothing;
+		m->matrix = jit_object_findregistered(m->name);
+		if (!m->matrix) {
+			jit_error_code(x, JIT_ERR_MATRIX_UNKNOWN);
+		} else {
+			m->inlet = proxy_getinlet((t_object *)x);
+			
+			// the script sees the data in place, for the duration of the handler:
+			savelock = (long)jit_object_method(m->matrix, _jit_sym_lock, 1);
+			jit_object_method(m->matrix, _jit_sym_getinfo, &m->info);
+			jit_object_method(m->matrix, _jit_sym_getdata, &m->bp);
+			if (m->bp) {
+				lua_getfield(L, LUA_REGISTRYINDEX, "luajit.matrix_in");
+				luajit_pcall(x, L, 1, top + 1);
+			} else {
+				jit_error_code(x, JIT_ERR_INVALID_INPUT);
+			}
+			jit_object_method(m->matrix, _jit_sym_lock, savelock);
+			m->bp = 0;
+		}
+	}
+	lua_settop(L, top);
+	systhread_mutex_unlock(x->control_mutex);
+}
+
+// THE OTHER DOMAINS, on their own threads: nothing here may block (the audio thread
+// especially), and Lua errors are handed to the main thread to report.
+
+void luajit_domain_error(t_luajit *x, t_luajit_domain *d, lua_State *L) {
+	const char *err = lua_tostring(L, -1);
+	if (!d->haserror) {
+		strncpy(d->error, err ? err : "error in script", sizeof(d->error) - 1);
+		d->error[sizeof(d->error) - 1] = 0;
+		RINGBUFFER_BARRIER();
+		d->haserror = 1;
+	}
+	qelem_set(x->control_qelem);
+}
+
+// hand a state back to the main thread to close:
+void luajit_domain_retire(t_luajit *x, t_luajit_domain *d, lua_State *L) {
+	if (d->zombie && ringbuffer_write(&d->retired, &d->zombie)) {
+		d->zombie = 0;
+	}
+	if (!ringbuffer_write(&d->retired, &L)) {
+		if (d->zombie) {
+			lua_close(d->zombie);	// last resort, the main thread isn't keeping up
+		}
+		d->zombie = L;
+	}
+	qelem_set(x->control_qelem);
+}
+
+// call the global function name, if the script defines it; returns non-zero on error:
+int luajit_domain_call(t_luajit *x, t_luajit_domain *d, const char *name, long argc, double *argv) {
+	lua_State *L = d->L;
 	long i;
-	t_atom_long jump[JIT_MATRIX_MAX_PLANECOUNT];
-	void *o, *p;
+	int err = 0;
+	
+	if (!L || d->failed) return 0;
+	lua_getfield(L, LUA_REGISTRYINDEX, "debug.traceback");
+	lua_getfield(L, LUA_GLOBALSINDEX, name);
+	if (lua_isfunction(L, -1)) {
+		for (i=0; i<argc; i++) {
+			lua_pushnumber(L, argv[i]);
+		}
+		if (lua_pcall(L, argc, 0, 1)) {
+			luajit_domain_error(x, d, L);
+			err = 1;
+		}
+	}
+	lua_settop(L, 0);
+	return err;
+}
+
+// the hand-off point: switch to a new state, and apply the messages queued since
+// the last call:
+void luajit_domain_service(t_luajit *x, t_luajit_domain *d) {
+	t_luajit_msg msg;
+	double args[2];
+	
+	while (ringbuffer_read(&d->inbox, &msg)) {
+		if (msg.L) {
+			if (d->L) luajit_domain_retire(x, d, d->L);
+			d->L = msg.L;
+			d->failed = 0;
+			if (d == &x->audio) {
+				args[0] = x->dsp.samplerate;
+				args[1] = x->dsp.frames;
+				luajit_domain_call(x, d, "dsp", 2, args);
+			}
+		} else {
+			luajit_domain_call(x, d, msg.name, msg.argc, msg.argv);
+		}
+	}
+}
+
+// GARBAGE COLLECTION: the collector normally runs whenever allocation triggers it,
+// which may be in the middle of a frame. With a gcbudget, it also runs in the idle
+// time after each frame, which keeps it ahead of allocation so that it rarely has to
+// run mid-frame (Lua's own schedule remains as a backstop).
+
+void luajit_gc_setparams(t_luajit *x, lua_State *L) {
+	lua_gc(L, LUA_GCSETPAUSE, x->gcpause);
+	lua_gc(L, LUA_GCSETSTEPMUL, x->gcstepmul);
+}
+
+// the heap size (KB) of L:
+double luajit_gc_heap(lua_State *L) {
+	return lua_gc(L, LUA_GCCOUNT, 0) + lua_gc(L, LUA_GCCOUNTB, 0) / 1024.;
+}
 
-	o = max_jit_obex_jitob_get(x);
-	jit_attr_getlong_array(o, gensym("jump"), JIT_MATRIX_MAX_PLANECOUNT, jump);
+// after a frame drawn with L: collect for up to gcbudget microseconds, and report
+// the heap size (KB) & the time spent (µs) as "gc <heap> <time>". A step while the
+// collector rests would start a new cycle, so between cycles (the registry's
+// luajit.gcrest is the heap size at the end of the last one) it only steps once
+// the heap has grown by gcpause, as Lua's own schedule would:
+void luajit_gc_idle(t_luajit *x, lua_State *L) {
+	double start = systimer_gettime();
+	double us = 0;
+	int resting;
+	t_atom a[2];
 	
-	for(i=0; i < x->outlets; i++) {
-		p=max_jit_mop_getoutput(x,i+1);
-		jit_attr_setlong(p,gensym("minplanecount"),jump[i]);
-		jit_attr_setlong(p,gensym("maxplanecount"),jump[i]);
+	luajit_gc_setparams(x, L);
+	lua_getfield(L, LUA_REGISTRYINDEX, "luajit.gcrest");
+	resting = lua_isnumber(L, -1) && luajit_gc_heap(L) < lua_tonumber(L, -1) * x->gcpause / 100.;
+	lua_pop(L, 1);
+	if (!resting && x->gcbudget > 0) {
+		// mid-cycle until a step finishes one:
+		lua_pushnil(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, "luajit.gcrest");
+		while (us < x->gcbudget) {
+			// stop at the end of a cycle, the next can wait for the heap to grow:
+			if (lua_gc(L, LUA_GCSTEP, 0)) {
+				lua_pushnumber(L, luajit_gc_heap(L));
+				lua_setfield(L, LUA_REGISTRYINDEX, "luajit.gcrest");
+				break;
+			}
+			us = (systimer_gettime() - start) * 1000.;
+		}
 	}
+	if (x->gcreport) {
+		us = (systimer_gettime() - start) * 1000.;
+		atom_setfloat(a, luajit_gc_heap(L));
+		atom_setfloat(a + 1, us);
+		outlet_anything(x->lua_outlet, ps_gc, 2, a);
+	}
+}
+
+// the control state now; the draw state at its next frame:
+void luajit_gc_update(t_luajit *x) {
+	systhread_mutex_lock(x->control_mutex);
+	if (x->L) luajit_gc_setparams(x, x->L);
+	systhread_mutex_unlock(x->control_mutex);
+}
+
+t_max_err luajit_gcpause_set(t_luajit *x, t_object *attr, long argc, t_atom *argv) {
+	x->gcpause = MAX(atom_getlong(argv), 0);
+	luajit_gc_update(x);
+	return 0;
+}
+
+t_max_err luajit_gcstepmul_set(t_luajit *x, t_object *attr, long argc, t_atom *argv) {
+	x->gcstepmul = MAX(atom_getlong(argv), 0);
+	luajit_gc_update(x);
+	return 0;
+}
+
+// gc collect: a full collection of the control state; gc report: "gc <heap> 0" now
+void luajit_gc(t_luajit *x, t_symbol *s, long argc, t_atom *argv) {
+	t_symbol *cmd = argc ? atom_getsym(argv) : _sym_nothing;
+	t_atom a[2];
 	
-	max_jit_mop_jit_matrix(x,s,argc,argv);
-	*/
+	systhread_mutex_lock(x->control_mutex);
+	if (!x->L) {
+		// nothing to do
+	} else if (cmd == gensym("collect")) {
+		lua_gc(x->L, LUA_GCCOLLECT, 0);
+	} else if (cmd == gensym("report")) {
+		atom_setfloat(a, lua_gc(x->L, LUA_GCCOUNT, 0) + lua_gc(x->L, LUA_GCCOUNTB, 0) / 1024.);
+		atom_setfloat(a + 1, 0);
+		outlet_anything(x->lua_outlet, ps_gc, 2, a);
+	} else {
+		object_error((t_object *)x, "gc: expects collect or report");
+	}
+	systhread_mutex_unlock(x->control_mutex);
+}
+
+// profile start|stop|dump: calls require("profile")[cmd]() in the main script's
+// state (see modules/profile.lua); the profile is lost when the script reloads.
+void luajit_profile(t_luajit *x, t_symbol *s, long argc, t_atom *argv) {
+	t_symbol *cmd = argc ? atom_getsym(argv) : _sym_nothing;
+	lua_State *L;
+	int top;
+
+	if (cmd != gensym("start") && cmd != gensym("stop") && cmd != gensym("dump")) {
+		object_error((t_object *)x, "profile: expects start, stop or dump");
+		return;
+	}
+	systhread_mutex_lock(x->control_mutex);
+	L = x->L;
+	if (L) {
+		top = lua_gettop(L);
+		lua_getfield(L, LUA_REGISTRYINDEX, "debug.traceback");
+		lua_getglobal(L, "require");
+		lua_pushstring(L, "profile");
+		if (luajit_pcall_result(x, L, 1, top + 1) == 0) {
+			lua_getfield(L, -1, cmd->s_name);
+			luajit_pcall(x, L, 0, top + 1);
+		}
+		lua_settop(L, top);
+	}
+	systhread_mutex_unlock(x->control_mutex);
+}
+
+t_jit_err luajit_draw(t_luajit *x) {
+	t_luajit_domain *d = &x->draw;
+	t_jit_err err;
+	
+	if (d->file == _sym_none) {
+		// draw() is part of the main script:
+		err = luajit_dispatch(x, ps_draw, 0, 0) ? JIT_ERR_GENERIC : JIT_ERR_NONE;
+		systhread_mutex_lock(x->control_mutex);
+		if (x->L) luajit_gc_idle(x, x->L);
+		systhread_mutex_unlock(x->control_mutex);
+		return err;
+	}
+	luajit_domain_service(x, d);
+	err = luajit_domain_call(x, d, "draw", 0, 0) ? JIT_ERR_GENERIC : JIT_ERR_NONE;
+	if (d->L) luajit_gc_idle(x, d->L);
+	return err;
 }
 
 void luajit_perform64(t_luajit *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam)
 {
-	t_double *in1 = ins[0];
-	t_double *in2 = ins[1];
-	t_double *out = outs[0];
-	t_double ftmp;
+	t_luajit_domain *d = &x->audio;
+	t_luajit_dsp *dsp = &x->dsp;
+	lua_State *L;
+	long i;
 	
-//	if (IS_DENORM_DOUBLE(*in1) || IS_DENORM_DOUBLE(*in2)) {
-//		static int counter = 0; 
-//		post("luajit (%p): saw denorm (%d)", x, counter++); 
-//	}
-
-	while (sampleframes--) {
-		ftmp = *in1++ + *in2++;
-		//FIX_DENORM_NAN_DOUBLE(ftmp);
-		*out++ = ftmp;
+	dsp->frames = sampleframes;
+	luajit_domain_service(x, d);
+	L = d->L;
+	
+	if (!L) {
+		// no dspfile: out = in1 + in2
+		t_double *in1 = ins[0];
+		t_double *in2 = ins[1];
+		t_double *out = outs[0];
+		while (sampleframes--) {
+			*out++ = *in1++ + *in2++;
+		}
+		return;
+	}
+	
+	if (!d->failed) {
+		dsp->numins = MIN(numins, LUAJIT_DSP_MAXCHANNELS);
+		dsp->numouts = MIN(numouts, LUAJIT_DSP_MAXCHANNELS);
+		for (i=0; i<dsp->numins; i++) dsp->ins[i] = ins[i];
+		for (i=0; i<dsp->numouts; i++) dsp->outs[i] = outs[i];
+		
+		// perform(ins, outs, n), through the wrapper dsp.lua installs:
+		lua_getfield(L, LUA_REGISTRYINDEX, "debug.traceback");
+		lua_getfield(L, LUA_REGISTRYINDEX, "luajit.perform");
+		if (lua_pcall(L, 0, 0, 1)) {
+			luajit_domain_error(x, d, L);
+			d->failed = 1;
+		}
+		lua_settop(L, 0);
+		
+		// a bounded amount of garbage collection per block, then stop it again so that
+		// it never runs inside perform():
+		lua_gc(L, LUA_GCSTEP, x->dspgc);
+		lua_gc(L, LUA_GCSTOP, 0);
+	}
+	if (d->failed) {
+		for (i=0; i<numouts; i++) memset(outs[i], 0, sampleframes * sizeof(double));
 	}
 }
 
 void luajit_dsp64(t_luajit *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags) {
-	post("my sample rate is: %f", samplerate);
+	t_luajit_msg msg;
+	
+	x->dsp.samplerate = samplerate;
+	x->dsp.frames = maxvectorsize;
+	
+	// let the script know, from the audio thread:
+	strcpy(msg.name, "dsp");
+	msg.L = 0;
+	msg.argc = 2;
+	msg.argv[0] = samplerate;
+	msg.argv[1] = maxvectorsize;
+	luajit_domain_send(&x->audio, &msg);
 	
 	//dsp_add64(dsp64, (t_object*) x, (t_perfroutine64) luajit_perform64_method, 0, 0);
 	object_method(dsp64, gensym("dsp_add64"), x, luajit_perform64, 0, NULL);
@@ -330,14 +1209,60 @@ void luajit_dblclick(t_luajit *x) {
 	system(msg);
 }
 
+void luajit_domain_init(t_luajit_domain *d, unsigned int capacity) {
+	ringbuffer_init(&d->inbox, sizeof(t_luajit_msg), capacity);
+	ringbuffer_init(&d->outbox, sizeof(t_luajit_msg), capacity);
+	ringbuffer_init(&d->retired, sizeof(lua_State *), 16);
+	systhread_mutex_new(&d->inbox_mutex, 0);
+	d->file = _sym_none;
+}
+
+// once the owning thread can no longer run:
+void luajit_domain_free(t_luajit *x, t_luajit_domain *d) {
+	t_luajit_msg msg;
+	
+	while (ringbuffer_read(&d->inbox, &msg)) {
+		if (msg.L) lua_close(msg.L);
+	}
+	if (d->L) lua_close(d->L);
+	if (d->zombie) lua_close(d->zombie);
+	d->L = d->zombie = 0;
+	luajit_domain_collect(x, d);
+	ringbuffer_free(&d->inbox);
+	ringbuffer_free(&d->outbox);
+	ringbuffer_free(&d->retired);
+	systhread_mutex_free(d->inbox_mutex);
+	if (d->filewatcher) object_free(d->filewatcher);
+}
+
 void luajit_free(t_luajit *x) {
-	//dsp_free((t_pxobject *)x);
+	// out of the audio chain & the OpenGL context first, so that their states are ours again:
+	dsp_free((t_pxobject *)x);
+	jit_ob3d_free(x);
+	
+	qelem_free(x->control_qelem);
+	luajit_domain_free(x, &x->draw);
+	luajit_domain_free(x, &x->audio);
 	
-	x->lua_handlers.draw = 0;
-	if (x->L) lua_close(x->L);
+	if (x->L) luajit_close_later(x, x->L);
+	x->L = 0;
+	systhread_mutex_free(x->control_mutex);
+	
+	// let the closer finish:
+	if (x->closer) {
+		unsigned int ret;
+		systhread_mutex_lock(x->closer_mutex);
+		x->closer_quit = 1;
+		systhread_cond_signal(x->closer_cond);
+		systhread_mutex_unlock(x->closer_mutex);
+		systhread_join(x->closer, &ret);
+	}
+	systhread_cond_free(x->closer_cond);
+	systhread_mutex_free(x->closer_mutex);
+	ringbuffer_free(&x->closer_queue);
+	if (x->filewatcher) object_free(x->filewatcher);
 	
 	// free resources associated with our obex entry
-	jit_ob3d_free(x);
 	max_jit_object_free(x);
 }
 
@@ -350,6 +1275,26 @@ void *luajit_new(t_symbol *s, long argc, t_atom *argv)
 	
 	if (x = (t_luajit *)object_alloc(luajit_class)) {
 		
+		// configure audio:
+		dsp_setup((t_pxobject *)x,2);
+		outlet_new((t_pxobject *)x, "signal");
+		
+		ringbuffer_init(&x->closer_queue, sizeof(lua_State *), 64);
+		systhread_mutex_new(&x->closer_mutex, 0);
+		systhread_cond_new(&x->closer_cond, 0);
+		
+		// the control state's lock, and the queues to the other domains:
+		systhread_mutex_new(&x->control_mutex, SYSTHREAD_MUTEX_RECURSIVE);
+		x->control_qelem = qelem_new(x, (method)luajit_control_qfn);
+		luajit_domain_init(&x->draw, 64);
+		luajit_domain_init(&x->audio, 256);
+		
+		// collector defaults (LuaJIT's own), before the first state:
+		x->gcbudget = 0;
+		x->gcpause = 200;
+		x->gcstepmul = 200;
+		x->gcreport = 0;
+		
 		// make sure Lua works:
 		if (luajit_newstate(x) == 0) {
 			object_error((t_object *)x, "failed to allocate LuaJIT interpreter (not yet supported in OSX 64-bit mode)");
@@ -364,10 +1309,6 @@ void *luajit_new(t_symbol *s, long argc, t_atom *argv)
 		}
 		jit_ob3d_new(x, dest_name_sym);
 	
-		// configure audio:
-		dsp_setup((t_pxobject *)x,2);
-		outlet_new((t_pxobject *)x, "signal");
-		
 		// add a general purpose outlet (rightmost)
 		//max_jit_obex_dumpout_set(x, outlet_new(x,NULL));
 		x->lua_outlet = outlet_new(x, 0);
@@ -376,7 +1317,8 @@ void *luajit_new(t_symbol *s, long argc, t_atom *argv)
 		x->filename = _sym_none;
 		x->filepath = 0;
 		x->autowatch = 1;
-		x->lua_handlers.draw = 0;
+		x->dsp.samplerate = sys_getsr();
+		x->bccache = 1;
 		
 		attr_args_process(x, argc, argv);
 	}
@@ -403,6 +1345,8 @@ int C74_EXPORT main(void) {
 	#endif
 	
 	common_symbols_init();
+	ps_draw = gensym("draw");
+	ps_gc = gensym("gc");
 	
 	
 	maxclass = class_new("luajit", (method)luajit_new, (method)luajit_free, (long)sizeof(t_luajit), 
@@ -421,17 +1365,50 @@ int C74_EXPORT main(void) {
 	CLASS_ATTR_LONG(maxclass, "autowatch", 0, t_luajit, autowatch); 
 	CLASS_ATTR_LABEL(maxclass,	"autowatch",	0,	"automatically reload file when changed on disk");
 
+	CLASS_ATTR_SYM(maxclass, "drawfile", 0, t_luajit, draw.file);
+	CLASS_ATTR_LABEL(maxclass,	"drawfile",	0,	"Lua script run on the OpenGL thread, defines draw() (default: the main script's)");
+	CLASS_ATTR_ACCESSORS(maxclass, "drawfile", 0, luajit_drawfile_set);
+	
+	CLASS_ATTR_SYM(maxclass, "dspfile", 0, t_luajit, audio.file);
+	CLASS_ATTR_LABEL(maxclass,	"dspfile",	0,	"Lua script run on the audio thread, defines perform(ins, outs, n)");
+	CLASS_ATTR_ACCESSORS(maxclass, "dspfile", 0, luajit_dspfile_set);
+	
+	CLASS_ATTR_LONG(maxclass, "dspgc", 0, t_luajit, dspgc);
+	CLASS_ATTR_LABEL(maxclass,	"dspgc",	0,	"garbage collection per audio block, in KB (0 for the smallest step)");
+	CLASS_ATTR_FILTER_MIN(maxclass, "dspgc", 0);
+	
+	CLASS_ATTR_LONG(maxclass, "bccache", 0, t_luajit, bccache);
+	CLASS_ATTR_LABEL(maxclass,	"bccache",	0,	"cache compiled scripts & modules in the temp folder");
+	CLASS_ATTR_STYLE(maxclass, "bccache", 0, "onoff");
+	
+	CLASS_ATTR_DOUBLE(maxclass, "gcbudget", 0, t_luajit, gcbudget);
+	CLASS_ATTR_LABEL(maxclass,	"gcbudget",	0,	"microseconds of garbage collection after each frame");
+	CLASS_ATTR_FILTER_MIN(maxclass, "gcbudget", 0);
+	
+	CLASS_ATTR_LONG(maxclass, "gcpause", 0, t_luajit, gcpause);
+	CLASS_ATTR_LABEL(maxclass,	"gcpause",	0,	"collector pause, percent of the heap after a cycle (setpause)");
+	CLASS_ATTR_ACCESSORS(maxclass, "gcpause", 0, luajit_gcpause_set);
+	
+	CLASS_ATTR_LONG(maxclass, "gcstepmul", 0, t_luajit, gcstepmul);
+	CLASS_ATTR_LABEL(maxclass,	"gcstepmul",	0,	"collector speed relative to allocation, percent (setstepmul)");
+	CLASS_ATTR_ACCESSORS(maxclass, "gcstepmul", 0, luajit_gcstepmul_set);
+	
+	CLASS_ATTR_LONG(maxclass, "gcreport", 0, t_luajit, gcreport);
+	CLASS_ATTR_LABEL(maxclass,	"gcreport",	0,	"send gc <heap KB> <collection µs> after each frame");
+	CLASS_ATTR_STYLE(maxclass, "gcreport", 0, "onoff");
+	
 	CLASS_ATTR_OBJ(maxclass, "lua_outlet", 0, t_luajit, lua_outlet);
 	CLASS_ATTR_INVISIBLE(maxclass, "lua_outlet", 0);
 	
-	CLASS_ATTR_OBJ(maxclass, "lua_handlers", 0, t_luajit, lua_handlers);
-	CLASS_ATTR_ACCESSORS(maxclass, "lua_handlers", luajit_handlers_get, luajit_handlers_set);
-	CLASS_ATTR_INVISIBLE(maxclass, "lua_handlers", 0);
 	
 	class_dspinit(maxclass);
 	
 	class_addmethod(maxclass, (method)luajit_jit_matrix, "jit_matrix", A_GIMME, 0); 
 	class_addmethod(maxclass, (method)luajit_bang, "bang", 0);
+	class_addmethod(maxclass, (method)luajit_param, "param", A_GIMME, 0);
+	class_addmethod(maxclass, (method)luajit_todraw, "todraw", A_GIMME, 0);
+	class_addmethod(maxclass, (method)luajit_gc, "gc", A_GIMME, 0);
+	class_addmethod(maxclass, (method)luajit_profile, "profile", A_GIMME, 0);
 	class_addmethod(maxclass, (method)luajit_anything, "anything", A_GIMME, 0);
 
 	// set up object extension for 3d object, customized with flags
@@ -0,0 +1,62 @@
+-- The audio thread's side of luajit: luajit.c loads this into the state that runs
+-- the dspfile script, before the script itself. That state never sees max.lua, as
+-- the Max API must not be called from the audio thread.
+--
+-- The script defines perform(ins, outs, n), called for every signal block with the
+-- block's input and output signals as double * arrays (ins[0] is the left inlet):
+--
+--	function perform(ins, outs, n)
+--		local a, b, out = ins[0], ins[1], outs[0]
+--		for i = 0, n-1 do out[i] = a[i] * b[i] end
+--	end
+--
+-- Other functions are called from the messages "param <name> <numbers...>", or
+-- from param(name, ...) in the main script, just before the next block; dsp(sr, n)
+-- is called when audio starts. tocontrol(name, numbers...) calls name(...) in the
+-- main script, later, from the main thread. Garbage is collected in small steps
+-- between blocks (see the dspgc attribute), so perform() should allocate as little
+-- as possible.
+
+local ffi = require "ffi"
+
+ffi.cdef [[
+
+// see luajit.c:
+static const int LUAJIT_DSP_MAXCHANNELS = 32;
+typedef struct {
+	double *	ins[LUAJIT_DSP_MAXCHANNELS];
+	double *	outs[LUAJIT_DSP_MAXCHANNELS];
+	int32_t		numins;
+	int32_t		numouts;
+	int32_t		frames;
+	double		samplerate;
+} t_luajit_dsp;
+
+]]
+
+local dsp = {}
+
+-- filled in by luajit_perform64 before each block:
+local block = ffi.cast("t_luajit_dsp *", debug.getregistry()["luajit.dsp"])
+local ins, outs = block.ins, block.outs
+local fill, sizeof_double = ffi.fill, ffi.sizeof("double")
+
+dsp.block = block
+
+function dsp.samplerate()
+	return block.samplerate
+end
+
+-- called by luajit_perform64:
+debug.getregistry()["luajit.perform"] = function()
+	local f = perform
+	if f then
+		f(ins, outs, block.frames)
+	else
+		for i = 0, block.numouts-1 do
+			fill(outs[i], block.frames * sizeof_double)
+		end
+	end
+end
+
+return dsp
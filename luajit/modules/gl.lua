@@ -2028,6 +2028,187 @@ local gl = {
 	["debug"] = false,	-- automatically follow gl calls with glGetError()
 }
 
+-- BATCHING: between gl.Begin and gl.End, gl.Vertex, gl.Color, gl.Normal and
+-- gl.TexCoord don't call the driver; they record into float arrays, which gl.End
+-- draws with a single glDrawArrays. Outside Begin/End, gl.Color etc. set GL's
+-- current values directly, as before, and the last values recorded are left
+-- current after gl.End, as immediate mode would.
+-- batch.new(funcs) makes another recorder calling funcs.glDrawArrays etc. instead
+-- of the driver (e.g. a table of stubs, to check what would be drawn without a
+-- GL context); its count & vertices/colors/normals/texcoords fields are the batch
+-- recorded so far.
+
+local GL_FLOAT = lib.GL_FLOAT
+local GL_CLIENT_VERTEX_ARRAY_BIT = lib.GL_CLIENT_VERTEX_ARRAY_BIT
+local GL_VERTEX_ARRAY = lib.GL_VERTEX_ARRAY
+local GL_COLOR_ARRAY = lib.GL_COLOR_ARRAY
+local GL_NORMAL_ARRAY = lib.GL_NORMAL_ARRAY
+local GL_TEXTURE_COORD_ARRAY = lib.GL_TEXTURE_COORD_ARRAY
+local GL_CURRENT_COLOR = lib.GL_CURRENT_COLOR
+local GL_CURRENT_NORMAL = lib.GL_CURRENT_NORMAL
+local GL_CURRENT_TEXTURE_COORDS = lib.GL_CURRENT_TEXTURE_COORDS
+
+local batch = {}
+batch.__index = batch
+gl.batch = batch
+
+function batch.new(funcs, capacity)
+	local self = setmetatable({
+		lib = funcs or lib,
+		mode = nil,		-- the primitive being recorded, nil outside Begin/End
+		count = 0,
+		capacity = 0,
+		-- the current values, copied into each vertex once set in this batch:
+		hascolor = false, cr = 1, cg = 1, cb = 1, ca = 1,
+		hasnormal = false, nx = 0, ny = 0, nz = 1,
+		hastexcoord = false, ts = 0, tt = 0, tr = 0, tq = 1,
+	}, batch)
+	self:reserve(capacity or 1024)
+	return self
+end
+
+local function resize(a, size, old, new)
+	local b = ffi.new("GLfloat[?]", new * size)
+	if a then ffi.copy(b, a, old * size * ffi.sizeof("GLfloat")) end
+	return b
+end
+
+-- grow the arrays to hold at least n vertices:
+function batch:reserve(n)
+	local old = self.capacity
+	if n <= old then return end
+	local new = math.max(n, old * 2)
+	self.vertices = resize(self.vertices, 4, old, new)
+	self.colors = resize(self.colors, 4, old, new)
+	self.normals = resize(self.normals, 3, old, new)
+	self.texcoords = resize(self.texcoords, 4, old, new)
+	self.capacity = new
+end
+
+-- an attribute set for the first time in this batch applies to the vertices
+-- already recorded too, as GL's current value did:
+local current = ffi.new("GLfloat[4]")
+local function backfill(self, a, size, pname)
+	if self.count == 0 then return end
+	self.lib.glGetFloatv(pname, current)
+	for i = 0, self.count-1 do
+		for k = 0, size-1 do a[i*size+k] = current[k] end
+	end
+end
+
+function batch:Begin(mode)
+	-- (no check for a missing End: a script error between the two mustn't stop
+	-- drawing for good)
+	self.mode, self.count = mode, 0
+	self.hascolor, self.hasnormal, self.hastexcoord = false, false, false
+end
+
+function batch:End()
+	assert(self.mode, "gl.End: no gl.Begin")
+	self:flush()
+	self.mode = nil
+end
+
+-- draw what has been recorded so far, and start over (with the same mode):
+function batch:flush()
+	local n, funcs = self.count, self.lib
+	if n > 0 then
+		funcs.glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT)
+		funcs.glEnableClientState(GL_VERTEX_ARRAY)
+		funcs.glVertexPointer(4, GL_FLOAT, 0, self.vertices)
+		if self.hascolor then
+			funcs.glEnableClientState(GL_COLOR_ARRAY)
+			funcs.glColorPointer(4, GL_FLOAT, 0, self.colors)
+		end
+		if self.hasnormal then
+			funcs.glEnableClientState(GL_NORMAL_ARRAY)
+			funcs.glNormalPointer(GL_FLOAT, 0, self.normals)
+		end
+		if self.hastexcoord then
+			funcs.glEnableClientState(GL_TEXTURE_COORD_ARRAY)
+			funcs.glTexCoordPointer(4, GL_FLOAT, 0, self.texcoords)
+		end
+		funcs.glDrawArrays(self.mode, 0, n)
+		funcs.glPopClientAttrib()
+		self.count = 0
+	end
+	-- the current values are undefined after drawing from an enabled array:
+	if self.hascolor then funcs.glColor4f(self.cr, self.cg, self.cb, self.ca) end
+	if self.hasnormal then funcs.glNormal3d(self.nx, self.ny, self.nz) end
+	if self.hastexcoord then funcs.glTexCoord4d(self.ts, self.tt, self.tr, self.tq) end
+end
+
+function batch:Vertex(x, y, z, w)
+	z, w = z or 0, w or 1
+	if not self.mode then
+		self.lib.glVertex4d(x, y, z, w)
+		return
+	end
+	local n = self.count
+	if n == self.capacity then self:reserve(n + 1) end
+	local i = n * 4
+	local a = self.vertices
+	a[i], a[i+1], a[i+2], a[i+3] = x, y, z, w
+	if self.hascolor then
+		a = self.colors
+		a[i], a[i+1], a[i+2], a[i+3] = self.cr, self.cg, self.cb, self.ca
+	end
+	if self.hasnormal then
+		a = self.normals
+		local j = n * 3
+		a[j], a[j+1], a[j+2] = self.nx, self.ny, self.nz
+	end
+	if self.hastexcoord then
+		a = self.texcoords
+		a[i], a[i+1], a[i+2], a[i+3] = self.ts, self.tt, self.tr, self.tq
+	end
+	self.count = n + 1
+end
+
+function batch:Color(r, g, b, a)
+	r, g, b, a = r or 0, g or 0, b or 0, a or 1
+	if not self.mode then
+		self.lib.glColor4f(r, g, b, a)
+		return
+	end
+	if not self.hascolor then
+		backfill(self, self.colors, 4, GL_CURRENT_COLOR)
+		self.hascolor = true
+	end
+	self.cr, self.cg, self.cb, self.ca = r, g, b, a
+end
+
+function batch:Normal(x, y, z)
+	if not self.mode then
+		self.lib.glNormal3d(x, y, z)
+		return
+	end
+	if not self.hasnormal then
+		backfill(self, self.normals, 3, GL_CURRENT_NORMAL)
+		self.hasnormal = true
+	end
+	self.nx, self.ny, self.nz = x, y, z
+end
+
+function batch:TexCoord(s, t, r, q)
+	r, q = r or 0, q or 1
+	if not self.mode then
+		self.lib.glTexCoord4d(s, t, r, q)
+		return
+	end
+	if not self.hastexcoord then
+		backfill(self, self.texcoords, 4, GL_CURRENT_TEXTURE_COORDS)
+		self.hastexcoord = true
+	end
+	self.ts, self.tt, self.tr, self.tq = s, t, r, q
+end
+
+-- the recorder behind gl.Begin etc.:
+local recorder = batch.new(lib)
+batch.default = recorder
+
+function gl.Begin(mode) recorder:Begin(mode) end
+
 function gl.Clear(...)
 	if select('#', ...) > 0 then
 		lib.glClear(bit.bor(...))
@@ -2048,15 +2229,14 @@ end
 
 function gl.Color(r, g, b, a)
 	if type(r) == "table" then r, g, b, a = unpack(r) end
-	lib.glColor4f(r or 0, g or 0, b or 0, a or 1)
+	recorder:Color(r, g, b, a)
 end
 
 function gl.ColorMask(r, g, b, a)
 	if type(r) == "table" then r, g, b, a = unpack(r) end
 	lib.glColorMask(r or 0, g or 0, b or 0, a or 1)
 end
--- Why is this necessary? FFI bug? Clash with "End" and "end" ?
-function gl.End() lib.glEnd() end
+function gl.End() recorder:End() end
 
 
 function gl.Get(p) error("TODO for the array returns.") end
@@ -2079,7 +2259,7 @@ end
 
 function gl.Normal(x, y, z)
 	if type(x) == "table" then x, y, z = unpack(x) end
-	lib.glVertex3d(x, y, z)
+	recorder:Normal(x, y, z)
 end
 
 function gl.PixelStore(p, v) lib.glPixelStoref(p, v) end
@@ -2099,15 +2279,8 @@ end
 
 function gl.TexCoord(x, y, z, w)
 	if type(x) == "table" then x, y, z, w = unpack(x) end
-	if w then
-		lib.glTexCoord4d(x, y, z, w)
-	elseif z then
-		lib.glTexCoord3d(x, y, z)
-	elseif y then
-		lib.glTexCoord2d(x, y)
-	else
-		error("gl.Vertex: invalid arguments")
-	end
+	if not y then error("gl.TexCoord: invalid arguments") end
+	recorder:TexCoord(x, y, z, w)
 end
 
 function gl.Translate(x, y, z)
@@ -2119,15 +2292,8 @@ function gl.Vertex(x, y, z, w)
 	if type(x) == "userdata" or type(x) == "cdata" then
 		x, y, z, w = x:unpack()
 	elseif type(x) == "table" then x, y, z, w = unpack(x) end
-	if w then
-		lib.glVertex4d(x, y, z, w)
-	elseif z then
-		lib.glVertex3d(x, y, z)
-	elseif y then
-		lib.glVertex2d(x, y)
-	else
-		error("gl.Vertex: invalid arguments")
-	end
+	if not y then error("gl.Vertex: invalid arguments") end
+	recorder:Vertex(x, y, z, w)
 end
 
 function gl.TexParameter(target, pname)
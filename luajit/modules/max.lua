@@ -88,6 +88,10 @@ void *atom_getobj(const t_atom *a);
 t_symbol * gensym(const char * s);
 void post(const char *fmt, ...);	
 
+void *outlet_bang(void *o);
+void *outlet_int(void *o, t_atom_long n);
+void *outlet_float(void *o, double f);
+void *outlet_list(void *o, t_symbol *s, short ac, t_atom *av);
 void *outlet_anything(void *o, t_symbol *s, short ac, t_atom *av);
 
 void object_post(t_object *x, const char *s, ...);
@@ -99,6 +103,7 @@ t_symbol * object_attr_getsym(void *x, t_symbol *s);
 t_object * object_attr_getobj(void *x, t_symbol *s);
 
 t_max_err object_notify(void *x, t_symbol *s, void *data);
+t_max_err object_method_typed(void *x, t_symbol *s, long ac, t_atom *av, t_atom *rv);
 
 
 // Jitter object model
@@ -146,12 +151,14 @@ t_symbol * jit_symbol_unique();
 
 /// LUAJIT HOST BINDING
 
+// a locked matrix as seen from Lua (also used for matrices the script creates):
 typedef struct {
-	
-	int (*draw)();
-	void (*anything)(t_symbol *s, long argc, t_atom *argv);
-	void (*bang)();
-} t_luajit_handlers;
+	t_jit_matrix *	matrix;
+	t_symbol *		name;
+	char *			bp;
+	long			inlet;		// -1 for matrices created by the script
+	t_jit_matrix_info info;
+} t_luajit_matrix;
 
 ]]
 
@@ -171,6 +178,14 @@ local function gensym(s)
 	return symcache[s] or cachesym(s)
 end
 
+local symbol_ptr = ffi.typeof("t_symbol *")
+
+-- a string or an already resolved t_symbol *:
+local function tosym(s)
+	if type(s) == "string" then return symcache[s] or cachesym(s) end
+	return s
+end
+
 -- convert a lua type to a t_atom type:
 local function atom_set(atom, v)
 	local tv = type(v)
@@ -180,6 +195,8 @@ local function atom_set(atom, v)
 		lib.atom_setlong(atom, v and 1 or 0)
 	elseif tv == "string" then
 		lib.atom_setsym(atom, gensym(v))
+	elseif tv == "cdata" and ffi.istype(symbol_ptr, v) then
+		lib.atom_setsym(atom, v)
 	elseif tv == "cdata" or tv == "userdata" then
 		lib.atom_setobj(atom, v)
 	else
@@ -243,12 +260,12 @@ local t_jit_matrix = {
 t_jit_matrix.__index = t_jit_matrix
 
 function t_jit_matrix:lock()
-	return lib.jit_object_method(self, gensym("sym_lock"), 1)
+	return lib.jit_object_method(self, gensym("lock"), ffi.cast("void *", 1))
 end
 
 function t_jit_matrix:unlock(savelock)
 	assert(savelock, "unlock() requires an argument (the value previously returned by lock())")
-	lib.jit_object_method(self, gensym("sym_lock"), savelock)
+	lib.jit_object_method(self, gensym("lock"), savelock)
 	return self
 end
 
@@ -269,13 +286,13 @@ function t_jit_matrix:info()
 	
 	info = {
 		-- the meta-properties in a more Lua-friendly form:
-		size = info[0].size,
+		size = tonumber(info[0].size),
 		type = tostring(info[0].type),
-		flags = info[0].flags,
-		dimcount = info[0].dimcount,
+		flags = tonumber(info[0].flags),
+		dimcount = tonumber(info[0].dimcount),
 		dim = info[0].dim,
 		dimstride = info[0].dimstride,
-		planecount = info[0].planecount,
+		planecount = tonumber(info[0].planecount),
 		
 		-- the raw byte pointer:
 		--bp = ffi.new("char *", dataptr[0]),
@@ -289,35 +306,158 @@ end
 
 ffi.metatype("t_jit_matrix", t_jit_matrix)
 
-local jit_matrix = {}
-jit_matrix.__index = jit_matrix
+-- MATRIX VIEWS --
+
+-- typed pointers for each Jitter plane type:
+local sym_char, sym_long, sym_float32, sym_float64 = gensym("char"), gensym("long"), gensym("float32"), gensym("float64")
+local uint8_ptr = ffi.typeof("uint8_t *")
+local int32_ptr = ffi.typeof("int32_t *")
+local float_ptr = ffi.typeof("float *")
+local double_ptr = ffi.typeof("double *")
+local info_ptr = ffi.typeof("t_jit_matrix_info *")
+
+local function ptrtype(typesym)
+	if typesym == sym_char then return uint8_ptr
+	elseif typesym == sym_float32 then return float_ptr
+	elseif typesym == sym_float64 then return double_ptr
+	elseif typesym == sym_long then return int32_ptr
+	end
+	error("unknown matrix type " .. tostring(typesym))
+end
 
-local
-function jit_matrix_new(name, planecount, typename, ...)
-	-- name is optional:
+local function matrix_setinfo(info, planecount, typename, ...)
+	local dimcount = select("#", ...)
+	assert(dimcount > 0 and dimcount <= lib.JIT_MATRIX_MAX_DIMCOUNT, "matrix needs 1 to 32 dimensions")
+	info.planecount = planecount or 1
+	info.type = gensym(typename or "char")
+	info.dimcount = dimcount
+	local dims = {...}
+	for i = 1, dimcount do
+		info.dim[i-1] = dims[i]
+	end
+end
+
+-- re-read the info & data pointer after the matrix has changed:
+local function matrix_update(m)
+	local dataptr = ffi.new("char *[1]")
+	lib.jit_object_method(m.matrix, gensym("getinfo"), ffi.cast(info_ptr, m.info))
+	lib.jit_object_method(m.matrix, gensym("getdata"), dataptr)
+	m.bp = dataptr[0]
+end
+
+local function matrix_free(m)
+	if m.matrix ~= nil then
+		lib.jit_object_free(m.matrix)
+		m.matrix = nil
+	end
+end
+
+-- the matrices this state created; luajit.c calls luajit.release on the main thread
+-- before the state is closed (on another thread, where freeing them would race with
+-- a reloaded script registering the same names):
+local owned = setmetatable({}, { __mode = "k" })
+
+debug.getregistry()["luajit.release"] = function()
+	for m in pairs(owned) do matrix_free(m) end
+end
+
+-- a view of a matrix the script doesn't own:
+local function matrix_view(matrix, name)
+	local m = ffi.new("t_luajit_matrix")
+	m.matrix = matrix
+	m.name = name
+	m.inlet = -1
+	matrix_update(m)
+	return m
+end
+
+-- a matrix created (& freed) by the script; name is optional. If the name is taken
+-- (by another max.jit_matrix, or a jit.matrix in the patch), this is a view of that
+-- matrix instead:
+local function matrix_new(name, planecount, typename, ...)
 	if type(name) ~= "string" then
-		-- generate a new unique name:
-		return jit_matrix_new(
-			tostring(lib.jit_symbol_unique()),
-			name, planecount, typename, ...
-		)
+		return matrix_new(tostring(lib.jit_symbol_unique()), name, planecount, typename, ...)
 	end
-	-- does this matrix already exist?
-	local m = ffi.cast("t_jit_matrix *", max.jit_object_findregistered(gensym(name)))
-	if m == nil then
-		-- allocate
-	elseif planecount then
-		-- reconfigure
+	local info = ffi.new("t_jit_matrix_info[1]")
+	matrix_setinfo(info[0], planecount, typename, ...)
+	
+	local sym = gensym(name)
+	local new = lib.jit_object_new(gensym("jit_matrix"), info)
+	assert(new ~= nil, "failed to create matrix")
+	local registered = lib.jit_object_register(new, sym)
+	if registered ~= new then
+		lib.jit_object_free(new)
+		assert(registered ~= nil, "failed to register matrix")
+		return matrix_view(ffi.cast("t_jit_matrix *", registered), sym)
 	end
 	
+	local m = ffi.gc(ffi.new("t_luajit_matrix"), matrix_free)
+	m.name = sym
+	m.inlet = -1
+	m.matrix = ffi.cast("t_jit_matrix *", new)
+	matrix_update(m)
+	owned[m] = true
+	return m
 end
 
-setmetatable(jit_matrix, {
-	__call = function(mt, name, planecount, typename, ...)
-		local dims = {...}
+-- m = max.jit_matrix([name,] planecount, type, dim0, dim1, ...)
+-- 
+-- Matrices from jit_matrix(m) handlers are only valid until the handler returns;
+-- matrices created by the script live until they are garbage collected.
+ffi.metatype("t_luajit_matrix", {
+	__tostring = function(self)
+		return format("jit_matrix(%s, %d %s, %dx%d)", tostring(self.name), tonumber(self.info.planecount), tostring(self.info.type), tonumber(self.info.dim[0]), tonumber(tonumber(self.info.dimcount) > 1 and self.info.dim[1] or 1))
+	end,
+	
+	__index = {
+		-- typed pointer to the start of row y (default 0),
+		-- where plane p of cell x is at [x*planecount + p]:
+		ptr = function(self, y)
+			return ffi.cast(ptrtype(self.info.type), self.bp + (y or 0)*tonumber(self.info.dimstride[1]))
+		end,
+		
+		-- typed pointer to a cell:
+		cell = function(self, x, y)
+			return ffi.cast(ptrtype(self.info.type), self.bp + x*tonumber(self.info.dimstride[0]) + (y or 0)*tonumber(self.info.dimstride[1]))
+		end,
 		
+		dim = function(self, i)
+			return tonumber(self.info.dim[i or 0])
+		end,
+		
+		planecount = function(self)
+			return tonumber(self.info.planecount)
+		end,
 		
+		-- m:resize(planecount, type, dim0, dim1, ...) for script matrices; only
+		-- reallocates when something has changed:
+		resize = function(self, planecount, typename, ...)
+			assert(self.inlet < 0, "cannot resize an input matrix")
+			local info = ffi.new("t_jit_matrix_info[1]")
+			info[0] = self.info
+			matrix_setinfo(info[0], planecount, typename, ...)
+			local new = info[0]
+			local same = tonumber(new.planecount) == tonumber(self.info.planecount) and new.type == self.info.type and tonumber(new.dimcount) == tonumber(self.info.dimcount)
+			for i = 0, tonumber(new.dimcount)-1 do
+				same = same and tonumber(new.dim[i]) == tonumber(self.info.dim[i])
+			end
+			if not same then
+				lib.jit_object_method(self.matrix, gensym("setinfo"), info)
+				matrix_update(self)
+			end
+			return self
+		end,
 		
+		clear = function(self)
+			lib.jit_object_method(self.matrix, gensym("clear"))
+			return self
+		end,
+	},
+})
+
+local jit_matrix = setmetatable({}, {
+	__call = function(mt, ...)
+		return matrix_new(...)
 	end,
 })
 
@@ -370,61 +510,158 @@ local max = {
 	jit_matrix = jit_matrix,
 }
 
--- actually probably want to return a wrapper rather than the raw pointer
+-- the matrix registered as name, or a new 32x32 float32 one if there is none:
 function max:getmatrix(name)
-	local m = ffi.cast("t_jit_matrix *", max.jit_object_findregistered(gensym(name)))
-	if m == nil then
-		-- default properties:
-		local info = ffi.new("t_jit_matrix_info")
-		info.planecount = 1
-		info.type = gensym("float32")
-		info.dimcount = 2
-		info.dim[0] = 32
-		info.dim[1] = 32
-		
-		-- create & register it:
-		local m = ffi.cast("t_jit_matrix *", lib.jit_object_new(gensym("jit_matrix"), info))
-		m = max.jit_object_register(m, gensym(name))
-		
-		--[[
-		local info = ffi.new("t_jit_matrix_info[1]")
-		local dataptr = ffi.new("char *[1]")
-		max.jit_object_method(m, max.gensym("getinfo"), info)
-		max.jit_object_method(m, max.gensym("getdata"), dataptr)
-		local meta = {
-			-- the meta-properties in a more Lua-friendly form:
-			type = tostring(info[0].type),
-			planecount = info[0].planecount,
-			dimcount = info[0].dimcount,
-			dim = info[0].dim,
-			stride = info[0].dimstride,
-			
-			-- the raw byte pointer:
-			bp = ffi.new("char *", dataptr[0]),
-			
-			-- cached to prevent gc:
-			_raw = info,	
-		}
-		
-		print("matrix", meta.type, meta.planecount, meta.dim[0], meta.dim[1], meta._raw[0].size)
-		--]]
-		
-		-- TODO: this should install a gc handler from Lua to jit_object_free(m)
+	local existing = ffi.cast("t_jit_matrix *", lib.jit_object_findregistered(gensym(name)))
+	if existing == nil then
+		return matrix_new(name, 1, "float32", 32, 32)
 	end
-	return m
+	return matrix_view(existing, gensym(name))
+end
+
+-- HOT RELOAD --
+-- When the script file changes it runs again in a fresh state; a table returned by
+-- the old script's persist() function (plain values & tables only) is the global
+-- persisted while the new one loads. Within a state, max.reload(name) runs a module
+-- again and copies its new fields into the table already loaded, so code holding
+-- on to the module sees the new functions:
+function max.reload(name)
+	local old = package.loaded[name]
+	package.loaded[name] = nil
+	local ok, new = pcall(require, name)
+	if not ok then
+		package.loaded[name] = old
+		error(new, 2)
+	end
+	if type(old) == "table" and type(new) == "table" and old ~= new then
+		for k, v in pairs(new) do old[k] = v end
+		package.loaded[name] = old
+		return old
+	end
+	return new
 end
 
 local lua_outlet = this:attr_getobj("lua_outlet")
 assert(lua_outlet ~= nil, "could not acquire lua outlet")
 
+-- OUTLETS --
+
+-- Outlet functions write into preallocated atom buffers, which only grow. There
+-- is one buffer per nesting level, as a message sent out can come back into this
+-- object & send another before the first has been read. Message names can be
+-- strings or symbols from max.gensym (which skips the cache lookup).
+local atoms, atoms_size = {}, {}
+local depth = 1
+local sym_list, sym_jit_matrix = gensym("list"), gensym("jit_matrix")
+
+local function atoms_reserve(n)
+	assert(n <= 32767, "too many atoms for one message")
+	local size = atoms_size[depth] or 0
+	if n > size then
+		size = math.max(size, 64)
+		while size < n do size = size * 2 end
+		atoms[depth] = ffi.new("t_atom[?]", size)
+		atoms_size[depth] = size
+	end
+	return atoms[depth]
+end
+
+local function send(f, s, ac, av)
+	depth = depth + 1
+	f(lua_outlet, s, ac, av)
+	depth = depth - 1
+end
+
+-- set atoms from varargs, four at a time (rather than select(i, ...) per atom):
+local function atoms_fill(av, i, n, a, b, c, d, ...)
+	if i < n then atom_set(av[i], a) end
+	if i+1 < n then atom_set(av[i+1], b) end
+	if i+2 < n then atom_set(av[i+2], c) end
+	if i+3 < n then atom_set(av[i+3], d) end
+	if i+4 < n then return atoms_fill(av, i+4, n, ...) end
+end
+
+-- write n numbers from an FFI array or Lua table (1-based) into the buffer, as floats:
+local A_FLOAT = lib.A_FLOAT
+local function atoms_from(values, n, offset)
+	local av = atoms_reserve(n)
+	offset = offset or 0
+	if type(values) == "table" then
+		for i = 0, n-1 do
+			av[i].a_type = A_FLOAT
+			av[i].a_w.w_float = values[i+1+offset]
+		end
+	else
+		for i = 0, n-1 do
+			av[i].a_type = A_FLOAT
+			av[i].a_w.w_float = values[i+offset]
+		end
+	end
+	return av
+end
+
+-- outlet(name, ...)
 function outlet(name, ...)
-	assert(name and type(name) == "string", "outlet argument 1 must be a string")
 	local ac = select("#", ...)
-	local av = ffi.new("t_atom[?]", ac)
-	for i = 1, ac do
-		av[i-1]:set(select(i, ...))
+	local av = atoms_reserve(ac)
+	atoms_fill(av, 0, ac, ...)
+	send(lib.outlet_anything, tosym(name), ac, av)
+end
+
+function outlet_bang()
+	lib.outlet_bang(lua_outlet)
+end
+
+function outlet_int(v)
+	lib.outlet_int(lua_outlet, v)
+end
+
+function outlet_float(v)
+	lib.outlet_float(lua_outlet, v)
+end
+
+-- outlet_list(values, n [, name [, offset]]) sends n numbers from an FFI array (from
+-- offset), or outlet_list(values [, n ...]) the numbers of a Lua table, as a list or
+-- as a message called name:
+function outlet_list(values, n, name, offset)
+	if type(values) == "cdata" then
+		assert(n, "outlet_list: n is required for an FFI array")
 	end
-	lib.outlet_anything(lua_outlet, gensym(name), ac, av)
+	n = n or #values
+	local av = atoms_from(values, n, offset)
+	if name then
+		send(lib.outlet_anything, tosym(name), n, av)
+	else
+		send(lib.outlet_list, sym_list, n, av)
+	end
+end
+
+-- send a matrix out, by name:
+function outlet_matrix(m)
+	local av = atoms_reserve(1)
+	lib.atom_setsym(av, m.name)
+	send(lib.outlet_anything, sym_jit_matrix, 1, av)
+end
+
+-- The drawfile & dspfile scripts run in their own states, on their own threads;
+-- these queue a call to name(...) there, made before the next frame (todraw) or
+-- signal block (param). Arguments must be numbers. Those scripts can call back
+-- with tocontrol(name, ...), which arrives here as a message.
+local sym_param, sym_todraw = gensym("param"), gensym("todraw")
+local function queue(s, name, ...)
+	local ac = select("#", ...) + 1
+	local av = atoms_reserve(ac)
+	atom_set(av[0], name)
+	atoms_fill(av, 1, ac, ...)
+	lib.object_method_typed(this, s, ac, av, nil)
+end
+
+function param(name, ...)
+	queue(sym_param, name, ...)
+end
+
+function todraw(name, ...)
+	queue(sym_todraw, name, ...)
 end
 
 -- overload some globals:
@@ -437,65 +674,19 @@ function print(...)
 	lib.post(table.concat(args, " "))
 end
 
-local lua_handlers = ffi.cast("t_luajit_handlers *", this:attr_getobj("lua_handlers"))
-assert(lua_handlers ~= nil, "could not acquire lua handlers")
-
 assert(app == nil, "app already defined!")
 app = {
 	
 }
 
--- override C handlers:
-lua_handlers.draw = function()
-	if _G.draw and type(_G.draw) == "function" then
-		local ok, err = xpcall(_G.draw, debug.traceback)
-		if not ok then 
-			this:error(err) 
-			return 1
-		end
-	end
-	return 0
-end
-
-lua_handlers.anything = function(symbol, argc, argv)
-	local s = tostring(symbol)
-	local f = _G[s]
-	if f and type(f) == "function" then
-		local ok, err
-		if argc > 1 then
-			local args = {}
-			for i = 1, argc do
-				args[i] = atom_get(argv[i-1])
-			end
-			ok, err = xpcall(function() f(unpack(args)) end, debug.traceback)
-		elseif argc == 1 then
-			ok, err = xpcall(function() f(atom_get(argv[0])) end, debug.traceback)
-		else
-			ok, err = xpcall(f, debug.traceback)
-		end
-		if not ok then 
-			this:error(err)
-		end
-	else
-		f = _G.anything
-		if f and type(f) == "function" then
-			local ok, err = xpcall(function() f(s, argc, argv) end, debug.traceback)
-			if not ok then 
-				this:error(err)
-			end
-		end
-	end
-end
+-- Messages are dispatched from C (see luajit_dispatch in luajit.c): a message
+-- calls the global function of the same name with the message's arguments, or
+-- anything(name, ...) if there is no such function; draw() is called for each
+-- OpenGL frame, and jit_matrix(m) for each incoming matrix.
 
-lua_handlers.bang = function()
-	local f = _G.bang
-	if f and type(f) == "function" then
-		local ok, err = xpcall(f, debug.traceback)
-		if not ok then 
-			this:error(err)
-		end
-	end
-end
+-- the view of the incoming matrix, which luajit.c fills in before calling jit_matrix(m):
+local registry = debug.getregistry()
+registry["luajit.matrix_in"] = ffi.cast("t_luajit_matrix *", registry["luajit.matrix_in"])
 
 -- add lazy loader:
 return setmetatable(max, { 
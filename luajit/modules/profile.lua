@@ -0,0 +1,125 @@
+-- Where a script spends its time, and why its code leaves compiled traces; driven by
+-- the luajit object's "profile start|stop|dump" messages (see luajit_profile), or
+-- from a script:
+--
+--	local profile = require "profile"
+--	profile.start() ... profile.stop() profile.dump()
+--
+-- Samples come from jit.profile where LuaJIT has it (2.1); otherwise from a count
+-- hook, which only sees interpreted code, so compiled functions are under-counted.
+-- Trace aborts are collected with jit.attach, by reason & location, as jit.v would
+-- print them. dump() prints the report and sends it out as messages:
+--
+--	profile sample <function> <count>
+--	profile abort <reason> <location> <count>
+
+local jit = require "jit"
+local util = require "jit.util"
+local format = string.format
+
+-- the abort reasons' text, if jit.vmdef is installed:
+local ok, vmdef = pcall(require, "jit.vmdef")
+if not ok then vmdef = nil end
+
+local has_jitprofile, jitprofile = pcall(require, "jit.profile")
+
+local profile = {}
+
+local samples, aborts = {}, {}
+local nsamples, running = 0, false
+
+local function count(t, k)
+	t[k] = (t[k] or 0) + 1
+end
+
+local function fmtfunc(func, pc)
+	local info = util.funcinfo(func, pc)
+	if info.loc then
+		return info.loc
+	elseif info.ffid then
+		return vmdef and vmdef.ffnames[info.ffid] or format("builtin#%d", info.ffid)
+	elseif info.addr then
+		return format("C:%x", info.addr)
+	end
+	return "?"
+end
+
+local function fmterr(err, info)
+	if type(err) == "number" then
+		if type(info) == "function" then info = fmtfunc(info) end
+		if vmdef and vmdef.traceerr[err] then
+			return format(vmdef.traceerr[err], info)
+		end
+		return format("error %d (%s)", err, tostring(info))
+	end
+	return tostring(err)
+end
+
+-- jit.attach "trace" event:
+local function ontrace(what, tr, func, pc, otr, oex)
+	if what == "abort" then
+		count(aborts, fmterr(otr, oex) .. "\t" .. fmtfunc(func, pc))
+	end
+end
+
+-- count hook fallback: the function running every 1000 VM instructions
+local function onhook()
+	local info = debug.getinfo(2, "Sn")
+	if info then
+		nsamples = nsamples + 1
+		count(samples, format("%s:%d (%s)", info.short_src, info.linedefined, info.name or "?"))
+	end
+end
+
+-- jit.profile callback: the innermost function, every millisecond
+local function onsample(thread, n, vmstate)
+	nsamples = nsamples + n
+	local where = jitprofile.dumpstack(thread, "F", 1)
+	samples[where] = (samples[where] or 0) + n
+end
+
+function profile.start()
+	if running then return end
+	samples, aborts, nsamples = {}, {}, 0
+	jit.attach(ontrace, "trace")
+	if has_jitprofile then
+		jitprofile.start("fi1", onsample)
+	else
+		debug.sethook(onhook, "", 1000)
+	end
+	running = true
+end
+
+function profile.stop()
+	if not running then return end
+	jit.attach(ontrace)
+	if has_jitprofile then
+		jitprofile.stop()
+	else
+		debug.sethook()
+	end
+	running = false
+end
+
+local function sorted(t)
+	local keys = {}
+	for k in pairs(t) do keys[#keys+1] = k end
+	table.sort(keys, function(a, b) return t[a] > t[b] end)
+	return keys
+end
+
+function profile.dump()
+	local out = outlet or function() end	-- from max.lua, if the script loaded it
+	print(format("profile: %d samples (%s)", nsamples, has_jitprofile and "jit.profile" or "interpreter only"))
+	for _, k in ipairs(sorted(samples)) do
+		print(format("%6d %5.1f%%  %s", samples[k], 100 * samples[k] / math.max(nsamples, 1), k))
+		out("profile", "sample", k, samples[k])
+	end
+	for _, k in ipairs(sorted(aborts)) do
+		local reason, loc = k:match("^(.-)\t(.*)$")
+		print(format("%6d abort: %s at %s", aborts[k], reason, loc))
+		out("profile", "abort", reason, loc, aborts[k])
+	end
+end
+
+return profile
@@ -0,0 +1,75 @@
+/**
+	@file
+	ringbuffer - a bounded single-producer, single-consumer queue of fixed size elements
+
+	Neither side blocks or allocates: the writer owns the write counter, the reader owns
+	the read counter, and each only reads the other's. This makes it safe to use with the
+	audio thread at one end, as long as there is only one thread at each end (serialize
+	writers with a mutex if messages can come from several threads).
+*/
+
+#ifndef LUAJIT_RINGBUFFER_H
+#define LUAJIT_RINGBUFFER_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+	#include <windows.h>
+	#define RINGBUFFER_INLINE static __inline
+	#define RINGBUFFER_BARRIER() MemoryBarrier()
+#else
+	#define RINGBUFFER_INLINE static inline
+	#define RINGBUFFER_BARRIER() __sync_synchronize()
+#endif
+
+typedef struct {
+	char *			data;
+	unsigned int	elemsize;
+	unsigned int	mask;			// capacity - 1 (the capacity is a power of two)
+	volatile unsigned int write;	// free-running counters, only ever incremented
+	volatile unsigned int read;
+} t_ringbuffer;
+
+// capacity is rounded up to a power of two; returns non-zero on failure:
+RINGBUFFER_INLINE int ringbuffer_init(t_ringbuffer *rb, unsigned int elemsize, unsigned int capacity) {
+	unsigned int size = 1;
+	while (size < capacity) size <<= 1;
+	rb->data = (char *)calloc(size, elemsize);
+	rb->elemsize = elemsize;
+	rb->mask = size - 1;
+	rb->write = rb->read = 0;
+	return rb->data == 0;
+}
+
+RINGBUFFER_INLINE void ringbuffer_free(t_ringbuffer *rb) {
+	free(rb->data);
+	rb->data = 0;
+}
+
+RINGBUFFER_INLINE unsigned int ringbuffer_count(t_ringbuffer *rb) {
+	return rb->write - rb->read;
+}
+
+// writer side; returns 0 if the queue is full:
+RINGBUFFER_INLINE int ringbuffer_write(t_ringbuffer *rb, const void *elem) {
+	unsigned int w = rb->write;
+	if (w - rb->read > rb->mask) return 0;
+	memcpy(rb->data + (w & rb->mask) * rb->elemsize, elem, rb->elemsize);
+	RINGBUFFER_BARRIER();	// the element must be visible before the counter
+	rb->write = w + 1;
+	return 1;
+}
+
+// reader side; returns 0 if the queue is empty:
+RINGBUFFER_INLINE int ringbuffer_read(t_ringbuffer *rb, void *elem) {
+	unsigned int r = rb->read;
+	if (r == rb->write) return 0;
+	RINGBUFFER_BARRIER();	// don't read the element before seeing the counter
+	memcpy(elem, rb->data + (r & rb->mask) * rb->elemsize, rb->elemsize);
+	RINGBUFFER_BARRIER();	// nor release the slot before we're done with it
+	rb->read = r + 1;
+	return 1;
+}
+
+#endif